@@ -0,0 +1,124 @@
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include "map2img.h"
+
+// per-map arena: everything that lives exactly as long as one map (lumps,
+// classes, emission order, diff tables, ...) is bump allocated from a chain
+// of blocks. arena_reset() makes all of it free again. A map that needed
+// more than one block has its blocks replaced by a single one as big as
+// the biggest map so far, so a batch run hardly calls malloc() after its
+// biggest map and keeps that much memory, not the sum of all blocks it
+// ever grew.
+
+#define ARENA_ALIGN 16
+#define ARENA_MAX_BLOCK (64 << 20)
+
+typedef struct Arenablock {
+    struct Arenablock* next;
+    size_t size;
+    size_t used;
+    _Alignas(ARENA_ALIGN) char data[];
+} Arenablock;
+
+struct Arena {
+    Arenablock* first;
+    Arenablock* current;
+    Arenablock* last;
+    size_t block_size;  // size of the next new block, doubles up to ARENA_MAX_BLOCK
+    size_t peak;        // most bytes one map used between two resets
+};
+
+Arena* arena_create(size_t block_size) {
+    Arena* arena = malloc(sizeof(Arena));
+    arena->first      = NULL;
+    arena->current    = NULL;
+    arena->last       = NULL;
+    arena->block_size = block_size;
+    arena->peak       = 0;
+    return arena;
+}
+
+// appends a block of exactly size bytes
+static Arenablock* add_block(Arena* arena, size_t size) {
+    Arenablock* block = malloc(sizeof(Arenablock) + size);
+    if (block == NULL) return NULL;
+    block->next = NULL;
+    block->size = size;
+    block->used = 0;
+    if (arena->last) {
+        arena->last->next = block;
+    }
+    else {
+        arena->first = block;
+    }
+    arena->last = block;
+    return block;
+}
+
+void* arena_alloc(Arena* arena, size_t size) {
+    size = (size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+    Arenablock* block = arena->current;
+    // blocks behind current are still full of the previous map, they are
+    // emptied when the allocation moves on to them:
+    while (block && block->used + size > block->size) {
+        block = block->next;
+        if (block) block->used = 0;
+    }
+    if (block == NULL) {
+        block = add_block(arena, size > arena->block_size ? size : arena->block_size);
+        if (block && arena->block_size < ARENA_MAX_BLOCK) arena->block_size *= 2;
+        if (block == NULL) {
+            fprintf(stderr, "arena_alloc(): out of memory (%zu bytes)!\n", size);
+            return NULL;
+        }
+    }
+    arena->current = block;
+    void* p = block->data + block->used;
+    block->used += size;
+    return p;
+}
+
+void* arena_calloc(Arena* arena, size_t count, size_t size) {
+    void* p = arena_alloc(arena, count * size);
+    if (p) memset(p, 0, count * size);
+    return p;
+}
+
+static void free_blocks(Arena* arena) {
+    Arenablock* block = arena->first;
+    while (block) {
+        Arenablock* next = block->next;
+        free(block);
+        block = next;
+    }
+    arena->first   = NULL;
+    arena->current = NULL;
+    arena->last    = NULL;
+}
+
+void arena_reset(Arena* arena) {
+    // the blocks up to current hold the map that is done now:
+    size_t used = 0;
+    for (Arenablock* block = arena->first; block; block = block->next) {
+        used += block->used;
+        if (block == arena->current) break;
+    }
+    if (used > arena->peak) arena->peak = used;
+
+    if (arena->first != arena->last) {
+        // one block of the peak size fits the biggest map so far, a failed
+        // malloc() here only means the next map grows a chain again:
+        free_blocks(arena);
+        add_block(arena, arena->peak);
+    }
+    arena->current = arena->first;
+    if (arena->current) arena->current->used = 0;
+}
+
+void arena_free(Arena* arena) {
+    if (arena == NULL) return;
+    free_blocks(arena);
+    free(arena);
+}
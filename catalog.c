@@ -0,0 +1,278 @@
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "map2img.h"
+
+// catalog mode: walks a directory tree, maps every file into memory and
+// writes one JSON object per WAD (JSON Lines). Files are processed by a
+// thread pool; broken files are reported on stderr and skipped. Records
+// are written in file order, whichever thread finishes first.
+
+typedef struct {
+    char** paths;
+    int count;
+    int capacity;
+} Filelist;
+
+// result of one file, kept until all files before it are written
+typedef struct {
+    char* record;
+    size_t record_size;
+    const char* reason;  // NULL: cataloged, unless error is set
+    int error;           // errno, turned into a message under the lock
+    bool done;
+} Catalogentry;
+
+typedef struct {
+    Filelist* files;
+    Catalogentry* entries;
+    int next_entry;      // first entry that isn't written yet
+    FILE* output;
+    pthread_mutex_t lock;
+    int num_written;
+    int num_skipped;
+} Catalog;
+
+static void append_file(Filelist* list, const char* path) {
+    if (list->count == list->capacity) {
+        list->capacity = list->capacity ? list->capacity * 2 : 256;
+        list->paths = realloc(list->paths, list->capacity * sizeof(char*));
+    }
+    list->paths[list->count++] = strdup(path);
+}
+
+static bool collect_files(const char* dirname, Filelist* list) {
+    DIR* dir = opendir(dirname);
+    if (dir == NULL) {
+        fprintf(stderr, "collect_files(): could not open directory %s: %s\n", dirname, strerror(errno));
+        return false;
+    }
+    struct dirent* entry;
+    while ((entry = readdir(dir)) != NULL) {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) continue;
+        size_t len = strlen(dirname) + strlen(entry->d_name) + 2;
+        char* path = malloc(len);
+        snprintf(path, len, "%s/%s", dirname, entry->d_name);
+        // symlinked directories are not followed, a link to a parent
+        // would walk the same files over and over:
+        struct stat st;
+        if (lstat(path, &st) == 0) {
+            if (S_ISDIR(st.st_mode)) {
+                collect_files(path, list);
+            }
+            else if (S_ISREG(st.st_mode) || (S_ISLNK(st.st_mode) && stat(path, &st) == 0 && S_ISREG(st.st_mode))) {
+                append_file(list, path);
+            }
+        }
+        free(path);
+    }
+    closedir(dir);
+    return true;
+}
+
+static int compare_paths(const void* a, const void* b) {
+    return strcmp(*(char* const*)a, *(char* const*)b);
+}
+
+// every regular file below dirname, sorted, so the output order doesn't
+// depend on the file system. Returns -1 if dirname can't be opened.
+// Called before any pool is started, so strerror() is fine in here.
+int list_files(const char* dirname, char*** paths) {
+    Filelist files = { NULL, 0, 0 };
+    if (!collect_files(dirname, &files)) return -1;
+    if (files.count > 1) {
+        qsort(files.paths, files.count, sizeof(char*), compare_paths);
+    }
+    *paths = files.paths;
+    return files.count;
+}
+
+void free_files(char** paths, int count) {
+    for (int i=0; i<count; ++i) {
+        free(paths[i]);
+    }
+    free(paths);
+}
+
+void print_json_string(FILE* output, const char* s, size_t maxlen) {
+    fputc('"', output);
+    for (size_t i=0; i<maxlen && s[i] != '\0'; ++i) {
+        unsigned char c = s[i];
+        if (c == '"' || c == '\\') {
+            fprintf(output, "\\%c", c);
+        }
+        else if (c < 0x20) {
+            fprintf(output, "\\u%04x", c);
+        }
+        else {
+            fputc(c, output);
+        }
+    }
+    fputc('"', output);
+}
+
+// writes the JSON record for one mapped WAD into output.
+// returns false (and a reason) if the file is not a WAD or is damaged.
+static bool catalog_wad(const char* filename, const unsigned char* data, size_t size, FILE* output, const char** reason) {
+    Header header;
+    if (size < sizeof(Header)) {
+        *reason = "file too small for a WAD header";
+        return false;
+    }
+    memcpy(&header, data, sizeof(Header));
+    if (!is_wad_ident(header.identification)) {
+        *reason = "no IWAD/PWAD identification";
+        return false;
+    }
+    if (header.num_lumps < 0 || header.infotableofs < 0 ||
+            (size_t)header.infotableofs + (size_t)header.num_lumps * sizeof(Direntry) > size) {
+        *reason = "lump directory outside of file";
+        return false;
+    }
+
+    // one bulk read of the whole directory:
+    Direntry* direntries = malloc(header.num_lumps * sizeof(Direntry));
+    memcpy(direntries, data + header.infotableofs, header.num_lumps * sizeof(Direntry));
+    for (int i=0; i<header.num_lumps; ++i) {
+        if (direntries[i].filepos < 0 || direntries[i].size < 0 ||
+                (size_t)direntries[i].filepos + (size_t)direntries[i].size > size) {
+            *reason = "lump outside of file";
+            free(direntries);
+            return false;
+        }
+    }
+
+    fprintf(output, "{\"file\":");
+    print_json_string(output, filename, strlen(filename));
+    fprintf(output, ",\"type\":\"%.4s\",\"maps\":[", header.identification);
+    int num_maps = 0;
+    for (int i=0; i<header.num_lumps; ++i) {
+        if (!is_map_name(direntries[i].name)) continue;
+
+        long int num_vertexes = 0;
+        long int num_linedefs = 0;
+        long int num_things   = 0;
+        int min_x = 0, min_y = 0, max_x = 0, max_y = 0;
+
+        fprintf(output, "%s{\"name\":", num_maps ? "," : "");
+        print_json_string(output, direntries[i].name, 8);
+        fprintf(output, ",\"lumps\":{");
+        int j;
+        for (j=i+1; j<header.num_lumps && map_lump_index(direntries[j].name) >= 0; ++j) {
+            Direntry* d = &direntries[j];
+            fprintf(output, "%s", j>i+1 ? "," : "");
+            print_json_string(output, d->name, 8);
+            fprintf(output, ":%d", d->size);
+            if (strncmp(d->name, "THINGS", 8) == 0) {
+                num_things = d->size / sizeof(Thing);
+            }
+            else if (strncmp(d->name, "LINEDEFS", 8) == 0) {
+                num_linedefs = d->size / sizeof(Linedef);
+            }
+            else if (strncmp(d->name, "VERTEXES", 8) == 0) {
+                num_vertexes = d->size / sizeof(Vertex);
+                if (num_vertexes > 0) {
+                    // lumps in the mapping needn't be aligned:
+                    Vertex* vertexes = malloc(num_vertexes * sizeof(Vertex));
+                    memcpy(vertexes, data + d->filepos, num_vertexes * sizeof(Vertex));
+                    min_x = max_x = vertexes[0].x;
+                    min_y = max_y = vertexes[0].y;
+                    generate_minmax(&max_x, &min_x, &max_y, &min_y, vertexes, num_vertexes);
+                    free(vertexes);
+                }
+            }
+        }
+        fprintf(output, "},\"vertexes\":%ld,\"linedefs\":%ld,\"things\":%ld", num_vertexes, num_linedefs, num_things);
+        fprintf(output, ",\"bounds\":{\"min_x\":%d,\"min_y\":%d,\"max_x\":%d,\"max_y\":%d}}", min_x, min_y, max_x, max_y);
+        num_maps++;
+        i = j-1;
+    }
+    fprintf(output, "]}\n");
+    free(direntries);
+    return true;
+}
+
+static void catalog_job(int index, int thread, void* ctx) {
+    Catalog* catalog = ctx;
+    Catalogentry* entry = &catalog->entries[index];
+    const char* filename = catalog->files->paths[index];
+
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) {
+        entry->error = errno;
+    }
+    struct stat st;
+    if (!entry->error && fstat(fd, &st) < 0) {
+        entry->error = errno;
+    }
+    if (!entry->error && st.st_size < (off_t)sizeof(Header)) {
+        entry->reason = "file too small for a WAD header";
+    }
+    void* data = MAP_FAILED;
+    if (!entry->error && !entry->reason) {
+        data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data == MAP_FAILED) entry->error = errno;
+    }
+
+    if (!entry->error && !entry->reason) {
+        FILE* buffer = open_memstream(&entry->record, &entry->record_size);
+        bool ok = catalog_wad(filename, data, st.st_size, buffer, &entry->reason);
+        fclose(buffer);
+        if (!ok) entry->record_size = 0;
+    }
+    if (data != MAP_FAILED) munmap(data, st.st_size);
+    if (fd >= 0) close(fd);
+
+    // strerror() isn't thread safe, it is only called under the lock:
+    pthread_mutex_lock(&catalog->lock);
+    entry->done = true;
+    while (catalog->next_entry < catalog->files->count && catalog->entries[catalog->next_entry].done) {
+        Catalogentry* next = &catalog->entries[catalog->next_entry];
+        if (next->error || next->reason) {
+            fprintf(stderr, "catalog: skipping %s: %s\n", catalog->files->paths[catalog->next_entry],
+                    next->error ? strerror(next->error) : next->reason);
+            catalog->num_skipped++;
+        }
+        else {
+            fwrite(next->record, 1, next->record_size, catalog->output);
+            catalog->num_written++;
+        }
+        free(next->record);
+        next->record = NULL;
+        catalog->next_entry++;
+    }
+    pthread_mutex_unlock(&catalog->lock);
+}
+
+bool catalog_wads(const char* dirname, FILE* output, int num_threads, bool verbose) {
+    Filelist files = { NULL, 0, 0 };
+    files.count = list_files(dirname, &files.paths);
+    if (files.count < 0) return false;
+
+    Catalog catalog;
+    catalog.files       = &files;
+    catalog.entries     = calloc(files.count + 1, sizeof(Catalogentry));
+    catalog.next_entry  = 0;
+    catalog.output      = output;
+    catalog.num_written = 0;
+    catalog.num_skipped = 0;
+    pthread_mutex_init(&catalog.lock, NULL);
+
+    run_pool(files.count, num_threads, catalog_job, &catalog);
+
+    pthread_mutex_destroy(&catalog.lock);
+    free(catalog.entries);
+    if (verbose) {
+        fprintf(stderr, "catalog: %d file%s cataloged, %d skipped\n", catalog.num_written, catalog.num_written!=1 ? "s" : "", catalog.num_skipped);
+    }
+    free_files(files.paths, files.count);
+    return true;
+}
@@ -0,0 +1,234 @@
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include "map2img.h"
+
+// diff mode: the same map from two WADs in one svg. Linedefs are matched by
+// their (direction independent) vertex coordinates, things by position,
+// both through a hash table, so this is O(n) even for huge maps. A matched
+// element is unchanged if its attributes are equal too, modified otherwise.
+// Elements without a match are added (new map) or removed (old map); the
+// removed ones are appended to the new map's geometry so output_svg() can
+// draw everything at once.
+
+const Linestyle diff_linestyles[NUM_DIFF_CLASSES] = {
+    [DIFF_UNCHANGED] = { "unchanged", "u", "dimgrey",     0x696969 },
+    [DIFF_ADDED]     = { "added",     "a", "springgreen", 0x00ff7f },
+    [DIFF_REMOVED]   = { "removed",   "r", "red",         0xff0000 },
+    [DIFF_MODIFIED]  = { "modified",  "m", "gold",        0xffd700 },
+};
+
+const Thingstyle diff_thingstyles[NUM_DIFF_CLASSES] = {
+    [DIFF_UNCHANGED] = { "unchanged", "tu", "dimgrey",     0x696969, ITEM_SIZE,    false },
+    [DIFF_ADDED]     = { "added",     "ta", "springgreen", 0x00ff7f, MONSTER_SIZE, true },
+    [DIFF_REMOVED]   = { "removed",   "tr", "red",         0xff0000, MONSTER_SIZE, true },
+    [DIFF_MODIFIED]  = { "modified",  "tm", "gold",        0xffd700, MONSTER_SIZE, true },
+};
+
+// open addressing, the elements with the same key are chained through next
+typedef struct {
+    unsigned long long* keys;
+    int* heads;   // first element with this key, -1: empty slot, -2: all taken
+    int* next;    // next element with the same key, -1: end of chain
+    unsigned int mask;
+} Keytable;
+
+typedef unsigned long long (*element_key)(Wadinfo* wadinfo, int i);
+typedef bool (*element_same)(Wadinfo* a, int i, Wadinfo* b, int j);
+
+// the tables live in the map's arena like everything else of the diff,
+// false: out of memory
+static bool init_table(Keytable* table, Arena* arena, long int num_elements) {
+    unsigned int size = 16;
+    while (size < 2 * num_elements) size *= 2;
+    table->keys  = arena_alloc(arena, size * sizeof(unsigned long long));
+    table->heads = arena_alloc(arena, size * sizeof(int));
+    table->next  = arena_alloc(arena, (num_elements + 1) * sizeof(int));
+    table->mask  = size - 1;
+    if (table->keys == NULL || table->heads == NULL || table->next == NULL) return false;
+    memset(table->heads, -1, size * sizeof(int));
+    return true;
+}
+
+static unsigned int hash_key(unsigned long long key) {
+    key ^= key >> 33;
+    key *= 0xff51afd7ed558ccdULL;
+    key ^= key >> 33;
+    return (unsigned int)key;
+}
+
+// the chain head for key, an empty slot is claimed for it
+static int* find_slot(Keytable* table, unsigned long long key) {
+    for (unsigned int i=hash_key(key) & table->mask; ; i=(i+1) & table->mask) {
+        if (table->heads[i] == -1) {
+            table->keys[i] = key;
+            return &table->heads[i];
+        }
+        if (table->keys[i] == key) return &table->heads[i];
+    }
+}
+
+static unsigned int coord_key(Vertex v) {
+    return ((unsigned int)(unsigned short)v.x << 16) | (unsigned short)v.y;
+}
+
+static unsigned long long linedef_key(Wadinfo* wadinfo, int i) {
+    Linedef* linedef = &wadinfo->linedefs[i];
+    unsigned int a = coord_key(wadinfo->vertexes[(unsigned short)linedef->v_start]);
+    unsigned int b = coord_key(wadinfo->vertexes[(unsigned short)linedef->v_end]);
+    // a flipped linedef is the same line, but modified:
+    return a < b ? (unsigned long long)a << 32 | b : (unsigned long long)b << 32 | a;
+}
+
+static bool same_linedef(Wadinfo* a, int i, Wadinfo* b, int j) {
+    Linedef* la = &a->linedefs[i];
+    Linedef* lb = &b->linedefs[j];
+    return coord_key(a->vertexes[(unsigned short)la->v_start]) == coord_key(b->vertexes[(unsigned short)lb->v_start])
+        && la->flags == lb->flags && la->special == lb->special && la->tag == lb->tag;
+}
+
+static unsigned long long thing_key(Wadinfo* wadinfo, int i) {
+    Vertex pos = { wadinfo->things[i].x_pos, wadinfo->things[i].y_pos };
+    return coord_key(pos);
+}
+
+static bool same_thing(Wadinfo* a, int i, Wadinfo* b, int j) {
+    Thing* ta = &a->things[i];
+    Thing* tb = &b->things[j];
+    return ta->type == tb->type && ta->angle == tb->angle && ta->flags == tb->flags;
+}
+
+// sets the Diffclass of every new element and marks the matched old ones,
+// returns the number of removed (unmatched old) elements, -1: out of memory
+static long int match_elements(Wadinfo* old_map, long int num_old, Wadinfo* new_map, long int num_new,
+        element_key key, element_same same, unsigned char* classes, bool* matched) {
+    Keytable table;
+    if (!init_table(&table, new_map->arena, num_old)) return -1;
+    // inserted backwards, so every chain is in map order:
+    for (long int i=num_old-1; i>=0; --i) {
+        int* head = find_slot(&table, key(old_map, i));
+        table.next[i] = *head;
+        *head = i;
+    }
+    long int num_removed = num_old;
+    for (long int j=0; j<num_new; ++j) {
+        int* head = find_slot(&table, key(new_map, j));
+        int* pick = NULL;
+        for (int* link=head; *link >= 0; link=&table.next[*link]) {
+            if (same(old_map, *link, new_map, j)) {
+                pick = link;
+                break;
+            }
+        }
+        if (pick) {
+            classes[j] = DIFF_UNCHANGED;
+        }
+        else if (*head >= 0) {
+            pick = head;
+            classes[j] = DIFF_MODIFIED;
+        }
+        else {
+            classes[j] = DIFF_ADDED;
+            continue;
+        }
+        // taken elements leave the chain, duplicates can't match twice:
+        int i = *pick;
+        matched[i] = true;
+        *pick = table.next[i];
+        if (*head == -1) *head = -2;
+        num_removed--;
+    }
+    return num_removed;
+}
+
+// index of the vertex at v in diff->vertexes, appended if it isn't there yet
+static int vertex_index(Wadinfo* diff, Keytable* vertex_table, Vertex v) {
+    int* head = find_slot(vertex_table, coord_key(v));
+    if (*head < 0) {
+        *head = diff->num_vertexes;
+        diff->vertexes[diff->num_vertexes++] = v;
+    }
+    return *head;
+}
+
+// builds diff from new_map with the removed elements of old_map appended,
+// line_classes and thing_classes hold a Diffclass. All of it is allocated
+// from new_map's arena and goes away with free_lumps(new_map).
+bool diff_maps(Wadinfo* old_map, Wadinfo* new_map, Wadinfo* diff, bool verbose) {
+    Arena* arena = new_map->arena;
+    *diff = *new_map;
+    diff->line_order  = NULL;
+    diff->thing_order = NULL;
+    diff->map_index   = -1; // the indexed bounds are the new map's only
+    // at most every old element is removed and appended:
+    diff->line_classes  = arena_alloc(arena, new_map->num_linedefs + old_map->num_linedefs + 1);
+    diff->thing_classes = arena_alloc(arena, new_map->num_things + old_map->num_things + 1);
+    bool* matched_lines  = arena_calloc(arena, old_map->num_linedefs + 1, sizeof(bool));
+    bool* matched_things = arena_calloc(arena, old_map->num_things + 1, sizeof(bool));
+    if (diff->line_classes == NULL || diff->thing_classes == NULL || matched_lines == NULL || matched_things == NULL) {
+        return false;
+    }
+
+    long int removed_lines = match_elements(old_map, old_map->num_linedefs, new_map, new_map->num_linedefs,
+            linedef_key, same_linedef, diff->line_classes, matched_lines);
+    long int removed_things = match_elements(old_map, old_map->num_things, new_map, new_map->num_things,
+            thing_key, same_thing, diff->thing_classes, matched_things);
+    if (removed_lines < 0 || removed_things < 0) return false;
+
+    // removed linedefs mostly share their vertexes with the new map:
+    diff->vertexes = arena_alloc(arena, (new_map->num_vertexes + 2 * removed_lines + 1) * sizeof(Vertex));
+    Keytable vertex_table;
+    if (diff->vertexes == NULL || !init_table(&vertex_table, arena, new_map->num_vertexes + 2 * removed_lines)) {
+        return false;
+    }
+    memcpy(diff->vertexes, new_map->vertexes, new_map->num_vertexes * sizeof(Vertex));
+    for (long int i=0; i<new_map->num_vertexes; ++i) {
+        int* head = find_slot(&vertex_table, coord_key(new_map->vertexes[i]));
+        if (*head < 0) *head = i;
+    }
+
+    long int num_lines = new_map->num_linedefs;
+    diff->linedefs     = arena_alloc(arena, (num_lines + removed_lines + 1) * sizeof(Linedef));
+    if (diff->linedefs == NULL) return false;
+    memcpy(diff->linedefs, new_map->linedefs, num_lines * sizeof(Linedef));
+    for (long int i=0; i<old_map->num_linedefs; ++i) {
+        if (matched_lines[i]) continue;
+        Linedef linedef = old_map->linedefs[i];
+        linedef.v_start = vertex_index(diff, &vertex_table, old_map->vertexes[(unsigned short)linedef.v_start]);
+        linedef.v_end   = vertex_index(diff, &vertex_table, old_map->vertexes[(unsigned short)linedef.v_end]);
+        diff->line_classes[num_lines] = DIFF_REMOVED;
+        diff->linedefs[num_lines++]   = linedef;
+    }
+    diff->num_linedefs = num_lines;
+
+    long int num_things = new_map->num_things;
+    diff->things        = arena_alloc(arena, (num_things + removed_things + 1) * sizeof(Thing));
+    if (diff->things == NULL) return false;
+    if (num_things) memcpy(diff->things, new_map->things, num_things * sizeof(Thing));
+    for (long int i=0; i<old_map->num_things; ++i) {
+        if (matched_things[i]) continue;
+        diff->thing_classes[num_things] = DIFF_REMOVED;
+        diff->things[num_things++]      = old_map->things[i];
+    }
+    diff->num_things = num_things;
+
+    if (verbose) {
+        long int lines[NUM_DIFF_CLASSES]  = { 0 };
+        long int things[NUM_DIFF_CLASSES] = { 0 };
+        for (long int i=0; i<diff->num_linedefs; ++i) lines[diff->line_classes[i]]++;
+        for (long int i=0; i<diff->num_things; ++i) things[diff->thing_classes[i]]++;
+        fprintf(stderr, "%s: ", diff->mapname);
+        for (int i=0; i<NUM_DIFF_CLASSES; ++i) {
+            fprintf(stderr, "%s%ld/%ld %s", i ? ", " : "", lines[i], things[i], diff_linestyles[i].name);
+        }
+        fprintf(stderr, " (linedefs/things)\n");
+    }
+
+    // linedefs store 16 bit vertex numbers:
+    if (diff->num_vertexes > 65536) {
+        fprintf(stderr, "ERROR: %s has too many vertexes (%ld) for a diff!\n", diff->mapname, diff->num_vertexes);
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,247 @@
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <sys/stat.h>
+#include "map2img.h"
+
+// heatmap mode: where do things of each class (monsters, items, keys, ...)
+// end up, over a whole collection of WADs. Every map is squeezed into the
+// same HEATMAP_SIZE x HEATMAP_SIZE grid (its vertex bounds become the unit
+// square) and contributes a density that sums to 1 per class, so big maps
+// don't outweigh small ones. The WADs are read by a thread pool, every
+// thread adds into its own grids and only one map per thread is in memory
+// (in that thread's arena), the grids are summed up at the end. Memory is
+// bounded by the number of threads, not the number of maps.
+
+#define HEATMAP_SIZE 256
+#define HEATMAP_CELLS (HEATMAP_SIZE * HEATMAP_SIZE)
+
+typedef struct {
+    double* cells;                        // NUM_THING_CLASSES grids, NULL until the thread's first WAD
+    long int num_maps[NUM_THING_CLASSES]; // maps with at least one thing of the class
+    long int total_maps;
+    int num_files;
+    int num_skipped;
+    Arena* arena;
+} Heatgrid;
+
+typedef struct {
+    char** files;
+    Heatgrid* grids;  // one per thread
+} Heatmap;
+
+static int grid_cell(int pos, int min, int max) {
+    int cell = (long int)(pos - min) * HEATMAP_SIZE / (max - min + 1);
+    if (cell < 0) return 0;
+    if (cell >= HEATMAP_SIZE) return HEATMAP_SIZE - 1;
+    return cell;
+}
+
+// false: out of memory
+static bool add_map(Heatgrid* grid, Wadinfo* wadinfo) {
+    int max_x = wadinfo->vertexes[0].x;
+    int min_x = wadinfo->vertexes[0].x;
+    int max_y = wadinfo->vertexes[0].y;
+    int min_y = wadinfo->vertexes[0].y;
+    generate_minmax(&max_x, &min_x, &max_y, &min_y, wadinfo->vertexes, wadinfo->num_vertexes);
+
+    // the classes are needed twice, the counts come first:
+    unsigned char* classes = arena_alloc(wadinfo->arena, wadinfo->num_things + 1);
+    if (classes == NULL) return false;
+    long int counts[NUM_THING_CLASSES] = { 0 };
+    for (long int i=0; i<wadinfo->num_things; ++i) {
+        classes[i] = classify_thing(wadinfo->things[i].type);
+        counts[classes[i]]++;
+    }
+    for (long int i=0; i<wadinfo->num_things; ++i) {
+        Thing* thing = &wadinfo->things[i];
+        // row 0 is the north end of the map, like in the images:
+        int x = grid_cell(thing->x_pos, min_x, max_x);
+        int y = HEATMAP_SIZE - 1 - grid_cell(thing->y_pos, min_y, max_y);
+        grid->cells[classes[i] * HEATMAP_CELLS + y * HEATMAP_SIZE + x] += 1.0 / counts[classes[i]];
+    }
+    for (int c=0; c<NUM_THING_CLASSES; ++c) {
+        if (counts[c]) grid->num_maps[c]++;
+    }
+    grid->total_maps++;
+    return true;
+}
+
+// missing lumps (size -1) are left to get_lump() to report
+static bool lump_in_file(Direntry* direntry, off_t file_size) {
+    if (direntry->size < 0) return true;
+    return direntry->filepos >= 0 && (off_t)direntry->filepos + direntry->size <= file_size;
+}
+
+// the maps of one WAD go through find_map() and load_lumps() like in
+// main(), the lumps are read on demand and never all at once
+static void heatmap_job(int index, int thread, void* ctx) {
+    Heatmap* heatmap = ctx;
+    Heatgrid* grid = &heatmap->grids[thread];
+    Wadinfo wadinfo = { 0 };
+    wadinfo.filename = heatmap->files[index];
+    wadinfo.arena    = grid->arena;
+
+    wadinfo.wadfile = fopen(wadinfo.filename, "rb");
+    if (wadinfo.wadfile == NULL) {
+        fprintf(stderr, "heatmap: skipping %s: could not open it\n", wadinfo.filename);
+        grid->num_skipped++;
+        return;
+    }
+    // one damaged file must not take the whole collection down,
+    // read_directory() checks the directory against the file size and the
+    // size is kept for the lumps:
+    const char* reason = NULL;
+    struct stat st;
+    if (fstat(fileno(wadinfo.wadfile), &st) < 0 ||
+            fread(&wadinfo.header, 1, sizeof(Header), wadinfo.wadfile) != sizeof(Header)) {
+        reason = "file too small for a WAD header";
+    }
+    else if (!is_wad_ident(wadinfo.header.identification)) {
+        reason = "no IWAD/PWAD identification";
+    }
+    else if (!read_directory(&wadinfo)) {
+        reason = "could not read the lump directory";
+    }
+    if (reason) {
+        fprintf(stderr, "heatmap: skipping %s: %s\n", wadinfo.filename, reason);
+        fclose(wadinfo.wadfile);
+        grid->num_skipped++;
+        return;
+    }
+    if (grid->cells == NULL) {
+        grid->cells = calloc((size_t)NUM_THING_CLASSES * HEATMAP_CELLS, sizeof(double));
+    }
+
+    char mapname[9] = { 0 };
+    wadinfo.mapname = mapname;
+    for (int i=0; i<wadinfo.header.num_lumps; ++i) {
+        if (!is_map_name(wadinfo.directory[i].name)) continue;
+        strncpy(mapname, wadinfo.directory[i].name, 8);
+        if (!find_map(&wadinfo)) continue;
+        if (!lump_in_file(&wadinfo.lumpdir[LUMP_THINGS], st.st_size) || !lump_in_file(&wadinfo.lumpdir[LUMP_VERTEXES], st.st_size)) {
+            fprintf(stderr, "heatmap: skipping %s in %s: lump outside of file\n", mapname, wadinfo.filename);
+        }
+        else if (load_lumps(&wadinfo, NEED(LUMP_THINGS) | NEED(LUMP_VERTEXES)) && wadinfo.num_vertexes > 0) {
+            if (!add_map(grid, &wadinfo)) {
+                fprintf(stderr, "heatmap: skipping %s in %s: out of memory\n", mapname, wadinfo.filename);
+            }
+        }
+        free_lumps(&wadinfo);
+    }
+    free(wadinfo.directory);
+    fclose(wadinfo.wadfile);
+    grid->num_files++;
+}
+
+// black -> red -> yellow -> white
+static unsigned int heat_color(float t) {
+    float r = 3 * t, g = 3 * t - 1, b = 3 * t - 2;
+    unsigned int cr = r <= 0 ? 0 : r >= 1 ? 255 : (unsigned int)(r * 255);
+    unsigned int cg = g <= 0 ? 0 : g >= 1 ? 255 : (unsigned int)(g * 255);
+    unsigned int cb = b <= 0 ? 0 : b >= 1 ? 255 : (unsigned int)(b * 255);
+    return cr | (cg << 8) | (cb << 16) | 0xff000000;
+}
+
+// <prefix>_<class>.f32: the mean density per map as raw floats (row by
+// row, host byte order), <prefix>_<class>.png: the same on a square root
+// scale, so sparse areas stay visible next to the hot spots
+static bool write_grid(const char* prefix, const char* name, const double* cells, long int num_maps) {
+    float* values = malloc(HEATMAP_CELLS * sizeof(float));
+    float max = 0;
+    for (int i=0; i<HEATMAP_CELLS; ++i) {
+        values[i] = num_maps ? cells[i] / num_maps : 0;
+        if (values[i] > max) max = values[i];
+    }
+
+    size_t len = strlen(prefix) + strlen(name) + 6;
+    char* filename = malloc(len);
+    bool ok = true;
+    snprintf(filename, len, "%s_%s.f32", prefix, name);
+    FILE* output = fopen(filename, "wb");
+    if (output) {
+        fwrite(values, sizeof(float), HEATMAP_CELLS, output);
+        fclose(output);
+    }
+    else {
+        fprintf(stderr, "ERROR, could not open output file %s\n", filename);
+        ok = false;
+    }
+
+    snprintf(filename, len, "%s_%s.png", prefix, name);
+    output = fopen(filename, "wb");
+    if (output) {
+        unsigned int* pixels = malloc(HEATMAP_CELLS * sizeof(unsigned int));
+        for (int i=0; i<HEATMAP_CELLS; ++i) {
+            pixels[i] = heat_color(max > 0 ? sqrtf(values[i] / max) : 0);
+        }
+        if (!write_rgb_png(pixels, HEATMAP_SIZE, HEATMAP_SIZE, output)) ok = false;
+        fclose(output);
+        free(pixels);
+    }
+    else {
+        fprintf(stderr, "ERROR, could not open output file %s\n", filename);
+        ok = false;
+    }
+    free(filename);
+    free(values);
+    return ok;
+}
+
+bool heatmap_wads(const char* dirname, const char* prefix, int num_threads, bool verbose) {
+    Heatmap heatmap;
+    int num_files = list_files(dirname, &heatmap.files);
+    if (num_files < 0) return false;
+    if (num_threads < 1) num_threads = pool_default_threads();
+    if (num_threads > num_files) num_threads = num_files > 0 ? num_files : 1;
+    heatmap.grids = calloc(num_threads, sizeof(Heatgrid));
+    for (int t=0; t<num_threads; ++t) {
+        heatmap.grids[t].arena = arena_create(1 << 20);
+    }
+
+    run_pool(num_files, num_threads, heatmap_job, &heatmap);
+
+    // reduce into the first grid:
+    Heatgrid* sum = &heatmap.grids[0];
+    if (sum->cells == NULL) {
+        sum->cells = calloc((size_t)NUM_THING_CLASSES * HEATMAP_CELLS, sizeof(double));
+    }
+    for (int t=1; t<num_threads; ++t) {
+        Heatgrid* grid = &heatmap.grids[t];
+        if (grid->cells) {
+            for (int i=0; i<NUM_THING_CLASSES * HEATMAP_CELLS; ++i) {
+                sum->cells[i] += grid->cells[i];
+            }
+        }
+        for (int c=0; c<NUM_THING_CLASSES; ++c) {
+            sum->num_maps[c] += grid->num_maps[c];
+        }
+        sum->total_maps  += grid->total_maps;
+        sum->num_files   += grid->num_files;
+        sum->num_skipped += grid->num_skipped;
+    }
+
+    bool ok = true;
+    for (int c=0; c<NUM_THING_CLASSES; ++c) {
+        ok = write_grid(prefix, thingstyles[c].name, sum->cells + c * HEATMAP_CELLS, sum->num_maps[c]) && ok;
+    }
+    if (verbose) {
+        fprintf(stderr, "heatmap: %ld map%s from %d file%s, %d skipped (%dx%d cells, maps per class:",
+                sum->total_maps, sum->total_maps!=1 ? "s" : "", sum->num_files, sum->num_files!=1 ? "s" : "",
+                sum->num_skipped, HEATMAP_SIZE, HEATMAP_SIZE);
+        for (int c=0; c<NUM_THING_CLASSES; ++c) {
+            fprintf(stderr, " %s %ld", thingstyles[c].name, sum->num_maps[c]);
+        }
+        fprintf(stderr, ")\n");
+    }
+
+    for (int t=0; t<num_threads; ++t) {
+        free(heatmap.grids[t].cells);
+        arena_free(heatmap.grids[t].arena);
+    }
+    free(heatmap.grids);
+    free_files(heatmap.files, num_files);
+    return ok;
+}
@@ -0,0 +1,96 @@
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include "map2img.h"
+
+// locality ordered output: linedefs (by midpoint) and things are emitted
+// along a Hilbert curve over the 16 bit map coordinate space, so elements
+// that are close on the map are close in the file, too. The curve keys are
+// sorted with an LSD radix sort, which keeps it O(n) and stable (elements
+// with the same key stay in lump order).
+// https://en.wikipedia.org/wiki/Hilbert_curve
+
+// distance of (x, y) along the curve, both 0..65535
+static unsigned int hilbert_key(unsigned int x, unsigned int y) {
+    unsigned int d = 0;
+    for (unsigned int s=1u << 15; s>0; s>>=1) {
+        unsigned int rx = (x & s) > 0;
+        unsigned int ry = (y & s) > 0;
+        d += s * s * ((3 * rx) ^ ry);
+        // rotate the quadrant, so the curve stays continuous:
+        if (ry == 0) {
+            if (rx == 1) {
+                x = 0xffff - x;
+                y = 0xffff - y;
+            }
+            unsigned int t = x;
+            x = y;
+            y = t;
+        }
+    }
+    return d;
+}
+
+// map coordinates are signed
+static unsigned int map_key(int x, int y) {
+    return hilbert_key((x + 32768) & 0xffff, (y + 32768) & 0xffff);
+}
+
+// the element indexes sorted by their key, 8 bits per pass. keys is
+// used as one of the two buffers and comes back scrambled, everything
+// else comes from the map's arena. NULL: out of memory.
+static int* radix_order(Arena* arena, unsigned int* keys, long int n) {
+    unsigned int* key_buf[2] = { keys, arena_alloc(arena, (n + 1) * sizeof(unsigned int)) };
+    int* order_buf[2]        = { arena_alloc(arena, (n + 1) * sizeof(int)), arena_alloc(arena, (n + 1) * sizeof(int)) };
+    if (key_buf[1] == NULL || order_buf[0] == NULL || order_buf[1] == NULL) return NULL;
+    int cur = 0;
+    for (long int i=0; i<n; ++i) {
+        order_buf[0][i] = i;
+    }
+    for (int shift=0; shift<32; shift+=8) {
+        long int count[257] = { 0 };
+        for (long int i=0; i<n; ++i) {
+            count[((key_buf[cur][i] >> shift) & 0xff) + 1]++;
+        }
+        // all keys have the same byte here, nothing would move:
+        bool same = false;
+        for (int b=1; b<=256; ++b) {
+            if (count[b] == n) same = true;
+        }
+        if (same) continue;
+        for (int b=1; b<=256; ++b) {
+            count[b] += count[b-1];
+        }
+        for (long int i=0; i<n; ++i) {
+            unsigned int key = key_buf[cur][i];
+            long int pos = count[(key >> shift) & 0xff]++;
+            key_buf[!cur][pos]   = key;
+            order_buf[!cur][pos] = order_buf[cur][i];
+        }
+        cur = !cur;
+    }
+    return order_buf[cur];
+}
+
+// sets wadinfo->line_order and thing_order, output_svg() emits in that
+// order. false: out of memory.
+bool order_map(Wadinfo* wadinfo) {
+    unsigned int* keys = arena_alloc(wadinfo->arena, (wadinfo->num_linedefs + 1) * sizeof(unsigned int));
+    if (keys == NULL) return false;
+    for (long int i=0; i<wadinfo->num_linedefs; ++i) {
+        Vertex start = wadinfo->vertexes[(unsigned short)wadinfo->linedefs[i].v_start];
+        Vertex end   = wadinfo->vertexes[(unsigned short)wadinfo->linedefs[i].v_end];
+        keys[i] = map_key((start.x + end.x) >> 1, (start.y + end.y) >> 1);
+    }
+    wadinfo->line_order = radix_order(wadinfo->arena, keys, wadinfo->num_linedefs);
+    if (wadinfo->line_order == NULL) return false;
+
+    keys = arena_alloc(wadinfo->arena, (wadinfo->num_things + 1) * sizeof(unsigned int));
+    if (keys == NULL) return false;
+    for (long int i=0; i<wadinfo->num_things; ++i) {
+        keys[i] = map_key(wadinfo->things[i].x_pos, wadinfo->things[i].y_pos);
+    }
+    wadinfo->thing_order = radix_order(wadinfo->arena, keys, wadinfo->num_things);
+    return wadinfo->thing_order != NULL;
+}
@@ -0,0 +1,209 @@
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include "map2img.h"
+
+// html output: a self-contained page that draws the map on a canvas with
+// pan (drag) and zoom (mouse wheel). Instead of one DOM element per
+// linedef the geometry is embedded as base64 encoded typed arrays:
+//   vertexes:    Int16Array, x/y pairs in map coordinates
+//   lines:       Uint16Array, start/end vertex index pairs
+//   line_styles: Uint8Array, Lineclass * 2 (+ 1 for slim linedefs)
+//   things:      Int16Array, x/y pairs
+//   thing_styles:Uint8Array, Thingclass
+//   angles:      Int16Array, thing angle in degrees
+// The style tables are the ones output_svg() uses. All arrays are little
+// endian, like the WAD data they come from.
+
+unsigned int output_html_needs(Imginfo* imginfo) {
+    return output_svg_needs(imginfo);
+}
+
+static void print_base64(FILE* output, const void* data, size_t len) {
+    static const char digits[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    const unsigned char* p = data;
+    size_t i;
+    for (i=0; i+2<len; i+=3) {
+        unsigned int n = (p[i] << 16) | (p[i+1] << 8) | p[i+2];
+        fputc(digits[(n >> 18) & 63], output);
+        fputc(digits[(n >> 12) & 63], output);
+        fputc(digits[(n >> 6) & 63], output);
+        fputc(digits[n & 63], output);
+    }
+    if (i < len) {
+        unsigned int n = p[i] << 16;
+        if (i+1 < len) n |= p[i+1] << 8;
+        fputc(digits[(n >> 18) & 63], output);
+        fputc(digits[(n >> 12) & 63], output);
+        fputc(i+1 < len ? digits[(n >> 6) & 63] : '=', output);
+        fputc('=', output);
+    }
+}
+
+static void print_blob(FILE* output, const char* name, const void* data, size_t len) {
+    fprintf(output, "%s:\"", name);
+    print_base64(output, data, len);
+    fprintf(output, "\",\n");
+}
+
+static void print_html_escaped(FILE* output, const char* s, size_t maxlen) {
+    for (size_t i=0; i<maxlen && s[i] != '\0'; ++i) {
+        switch (s[i]) {
+            case '<': fprintf(output, "&lt;"); break;
+            case '>': fprintf(output, "&gt;"); break;
+            case '&': fprintf(output, "&amp;"); break;
+            case '"': fprintf(output, "&quot;"); break;
+            default:  fputc(s[i], output); break;
+        }
+    }
+}
+
+static const char* viewer_script =
+"function decode(s, type) {\n"
+"  const bin = atob(s), bytes = new Uint8Array(bin.length);\n"
+"  for (let i = 0; i < bin.length; ++i) bytes[i] = bin.charCodeAt(i);\n"
+"  return new type(bytes.buffer);\n"
+"}\n"
+"const vertexes = decode(map.vertexes, Int16Array), lines = decode(map.lines, Uint16Array);\n"
+"const lineStyles = decode(map.line_styles, Uint8Array), things = decode(map.things, Int16Array);\n"
+"const thingStyles = decode(map.thing_styles, Uint8Array), angles = decode(map.angles, Int16Array);\n"
+"// group the elements by style once, so every style is one path per frame:\n"
+"const lineGroups = map.line_colors.map(() => [[], []]);\n"
+"for (let i = 0; i < lineStyles.length; ++i) lineGroups[lineStyles[i] >> 1][lineStyles[i] & 1].push(i);\n"
+"const thingGroups = map.thing_colors.map(() => []);\n"
+"for (let i = 0; i < thingStyles.length; ++i) thingGroups[thingStyles[i]].push(i);\n"
+"let minX = Infinity, minY = Infinity, maxX = -Infinity, maxY = -Infinity;\n"
+"for (let i = 0; i < vertexes.length; i += 2) {\n"
+"  minX = Math.min(minX, vertexes[i]); maxX = Math.max(maxX, vertexes[i]);\n"
+"  minY = Math.min(minY, vertexes[i+1]); maxY = Math.max(maxY, vertexes[i+1]);\n"
+"}\n"
+"const canvas = document.getElementById('map'), ctx = canvas.getContext('2d');\n"
+"let zoom = map.scale, panX = 0, panY = 0, dirty = true;\n"
+"function resize() {\n"
+"  canvas.width = window.innerWidth; canvas.height = window.innerHeight; dirty = true;\n"
+"}\n"
+"function center() {\n"
+"  panX = canvas.width / 2 - (minX + maxX) / 2 * zoom;\n"
+"  panY = canvas.height / 2 + (minY + maxY) / 2 * zoom;\n"
+"}\n"
+"function draw() {\n"
+"  requestAnimationFrame(draw);\n"
+"  if (!dirty) return;\n"
+"  dirty = false;\n"
+"  ctx.setTransform(1, 0, 0, 1, 0, 0);\n"
+"  ctx.fillStyle = 'black';\n"
+"  ctx.fillRect(0, 0, canvas.width, canvas.height);\n"
+"  ctx.setTransform(zoom, 0, 0, -zoom, panX, panY);\n"
+"  for (let c = 0; c < lineGroups.length; ++c) {\n"
+"    for (let slim = 0; slim < 2; ++slim) {\n"
+"      const group = lineGroups[c][slim];\n"
+"      if (!group.length) continue;\n"
+"      ctx.beginPath();\n"
+"      for (const i of group) {\n"
+"        const a = lines[2*i] * 2, b = lines[2*i+1] * 2;\n"
+"        ctx.moveTo(vertexes[a], vertexes[a+1]);\n"
+"        ctx.lineTo(vertexes[b], vertexes[b+1]);\n"
+"      }\n"
+"      ctx.strokeStyle = map.line_colors[c];\n"
+"      ctx.lineWidth = map.line_widths[slim];\n"
+"      ctx.stroke();\n"
+"    }\n"
+"  }\n"
+"  for (let c = 0; c < thingGroups.length; ++c) {\n"
+"    const group = thingGroups[c], r = map.thing_sizes[c];\n"
+"    if (!group.length) continue;\n"
+"    ctx.beginPath();\n"
+"    for (const i of group) {\n"
+"      ctx.moveTo(things[2*i] + r, things[2*i+1]);\n"
+"      ctx.arc(things[2*i], things[2*i+1], r, 0, 2 * Math.PI);\n"
+"    }\n"
+"    ctx.fillStyle = map.thing_colors[c];\n"
+"    ctx.fill();\n"
+"    if (!map.thing_directions[c]) continue;\n"
+"    ctx.beginPath();\n"
+"    for (const i of group) {\n"
+"      const a = angles[i] * Math.PI / 180, len = map.direction_length;\n"
+"      ctx.moveTo(things[2*i], things[2*i+1]);\n"
+"      ctx.lineTo(things[2*i] + Math.cos(a) * len, things[2*i+1] + Math.sin(a) * len);\n"
+"    }\n"
+"    ctx.strokeStyle = 'yellow';\n"
+"    ctx.lineWidth = 1 / zoom;\n"
+"    ctx.stroke();\n"
+"  }\n"
+"}\n"
+"let drag = null;\n"
+"canvas.addEventListener('mousedown', e => { drag = [e.clientX - panX, e.clientY - panY]; });\n"
+"window.addEventListener('mouseup', () => { drag = null; });\n"
+"window.addEventListener('mousemove', e => {\n"
+"  if (!drag) return;\n"
+"  panX = e.clientX - drag[0]; panY = e.clientY - drag[1]; dirty = true;\n"
+"});\n"
+"canvas.addEventListener('wheel', e => {\n"
+"  e.preventDefault();\n"
+"  const f = Math.exp(-e.deltaY * 0.002);\n"
+"  panX = e.clientX - (e.clientX - panX) * f;\n"
+"  panY = e.clientY - (e.clientY - panY) * f;\n"
+"  zoom *= f; dirty = true;\n"
+"}, { passive: false });\n"
+"window.addEventListener('resize', resize);\n"
+"resize(); center(); draw();\n";
+
+void output_html(Imginfo* imginfo, Wadinfo* wadinfo, FILE* output) {
+    long int num_lines  = wadinfo->num_linedefs;
+    long int num_things = imginfo->draw_things ? wadinfo->num_things : 0;
+
+    unsigned short* lines   = malloc(2 * num_lines * sizeof(unsigned short) + 1);
+    unsigned char* line_styles = malloc(num_lines + 1);
+    for (long int i=0; i<num_lines; ++i) {
+        Linedef* linedef = &wadinfo->linedefs[i];
+        lines[2*i]     = (unsigned short)linedef->v_start;
+        lines[2*i + 1] = (unsigned short)linedef->v_end;
+        line_styles[i] = wadinfo->line_classes[i] * 2 + (linedef->flags == 4 ? 1 : 0);
+    }
+    int16_t* things = malloc(2 * num_things * sizeof(int16_t) + 1);
+    int16_t* angles = malloc(num_things * sizeof(int16_t) + 1);
+    for (long int i=0; i<num_things; ++i) {
+        things[2*i]     = wadinfo->things[i].x_pos;
+        things[2*i + 1] = wadinfo->things[i].y_pos;
+        angles[i]       = wadinfo->things[i].angle;
+    }
+
+    fprintf(output, "<!DOCTYPE html>\n<html>\n<head>\n<meta charset=\"utf-8\">\n<title>");
+    print_html_escaped(output, wadinfo->mapname, 8);
+    fprintf(output, "</title>\n");
+    fprintf(output, "<style>html,body{margin:0;height:100%%;overflow:hidden;background:black}canvas{display:block}</style>\n");
+    fprintf(output, "</head>\n<body>\n<canvas id=\"map\"></canvas>\n<script>\nconst map = {\n");
+    fprintf(output, "scale:%g,\n", imginfo->scale);
+    fprintf(output, "direction_length:%d,\n", MONSTER_SIZE + 4);
+    fprintf(output, "line_widths:[%d,%d],\n", LINEDEF_WIDTH, LINEDEF_SLIM);
+    fprintf(output, "line_colors:[");
+    for (int i=0; i<NUM_LINE_CLASSES; ++i) {
+        fprintf(output, "%s\"%s\"", i ? "," : "", linestyles[i].color);
+    }
+    fprintf(output, "],\nthing_colors:[");
+    for (int i=0; i<NUM_THING_CLASSES; ++i) {
+        fprintf(output, "%s\"%s\"", i ? "," : "", thingstyles[i].color);
+    }
+    fprintf(output, "],\nthing_sizes:[");
+    for (int i=0; i<NUM_THING_CLASSES; ++i) {
+        fprintf(output, "%s%d", i ? "," : "", thingstyles[i].size);
+    }
+    fprintf(output, "],\nthing_directions:[");
+    for (int i=0; i<NUM_THING_CLASSES; ++i) {
+        fprintf(output, "%s%d", i ? "," : "", thingstyles[i].direction);
+    }
+    fprintf(output, "],\n");
+    print_blob(output, "vertexes", wadinfo->vertexes, wadinfo->num_vertexes * sizeof(Vertex));
+    print_blob(output, "lines", lines, 2 * num_lines * sizeof(unsigned short));
+    print_blob(output, "line_styles", line_styles, num_lines);
+    print_blob(output, "things", things, 2 * num_things * sizeof(int16_t));
+    print_blob(output, "thing_styles", wadinfo->thing_classes, num_things);
+    print_blob(output, "angles", angles, num_things * sizeof(int16_t));
+    fprintf(output, "};\n%s</script>\n</body>\n</html>\n", viewer_script);
+
+    free(lines);
+    free(line_styles);
+    free(things);
+    free(angles);
+}
@@ -0,0 +1,363 @@
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "map2img.h"
+
+// sidecar index (-i): <wadfile>.m2i holds the lump directory, a hash table
+// over the lump names and one record per map with its lumps, bounds and
+// counts. It is mapped in one piece and trusted as long as size and
+// mtime of the WAD, the WAD header and the checksum over the index match,
+// otherwise it is rebuilt. Layout (native byte order, it never leaves the
+// machine):
+//   Indexheader
+//   Direntry directory[header.num_lumps]
+//   int lump_hash[hash_size]    directory index or -1, first lump wins
+//   Mapindex maps[num_maps]     in directory order
+
+#define INDEX_MAGIC "M2I"
+#define INDEX_VERSION 2
+
+typedef struct {
+    char magic[4];
+    int version;
+    long long wad_size;
+    long long wad_mtime_sec;
+    long long wad_mtime_nsec;
+    unsigned long long checksum; // index_checksum() of everything after this header
+    Header wad_header;
+    int hash_size;          // power of two
+    int num_maps;
+} Indexheader;
+
+typedef struct {
+    int lump;               // directory index of the map marker
+    Direntry lumpdir[NUM_MAP_LUMPS];
+    int min_x;
+    int min_y;
+    int max_x;
+    int max_y;
+    int num_vertexes;
+    int num_linedefs;
+    int num_things;
+} Mapindex;
+
+struct Wadindex {
+    char* data;             // the whole index file
+    size_t size;
+    bool mapped;            // data is mmap()ed (loaded) or malloc()ed (built)
+    Indexheader* header;
+    Direntry* directory;
+    int* lump_hash;
+    Mapindex* maps;
+};
+
+static unsigned int hash_lump_name(const char* name) {
+    unsigned int h = 2166136261u;
+    for (int i=0; i<8 && name[i]; ++i) {
+        h = (h ^ (unsigned char)name[i]) * 16777619u;
+    }
+    return h;
+}
+
+static char* index_filename(const char* filename) {
+    char* name = malloc(strlen(filename) + 5);
+    sprintf(name, "%s.m2i", filename);
+    return name;
+}
+
+static void set_pointers(Wadindex* index) {
+    index->header    = (Indexheader*)index->data;
+    index->directory = (Direntry*)(index->header + 1);
+    index->lump_hash = (int*)(index->directory + index->header->wad_header.num_lumps);
+    index->maps      = (Mapindex*)(index->lump_hash + index->header->hash_size);
+}
+
+static size_t index_size(int num_lumps, int hash_size, int num_maps) {
+    return sizeof(Indexheader) + num_lumps * sizeof(Direntry) + hash_size * sizeof(int) + num_maps * sizeof(Mapindex);
+}
+
+// 8 bytes per step, the check must not cost more than the directory
+// walk it saves
+static unsigned long long index_checksum(Wadindex* index, size_t size) {
+    const unsigned char* data = (unsigned char*)(index->header + 1);
+    size -= sizeof(Indexheader);
+    unsigned long long h = 0x9e3779b97f4a7c15ULL;
+    size_t i;
+    for (i=0; i+8<=size; i+=8) {
+        unsigned long long word;
+        memcpy(&word, data + i, 8);
+        h = (h ^ word) * 0xff51afd7ed558ccdULL;
+        h ^= h >> 29;
+    }
+    for (; i<size; ++i) {
+        h = (h ^ data[i]) * 0x100000001b3ULL;
+    }
+    return h;
+}
+
+// the index of filename if it is still valid for the WAD, NULL otherwise
+static Wadindex* load_index(Wadinfo* wadinfo, struct stat* wad_stat) {
+    char* name = index_filename(wadinfo->filename);
+    int fd = open(name, O_RDONLY);
+    free(name);
+    if (fd < 0) return NULL;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(Indexheader)) {
+        close(fd);
+        return NULL;
+    }
+    void* data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) return NULL;
+    Wadindex* index = malloc(sizeof(Wadindex));
+    index->data   = data;
+    index->size   = st.st_size;
+    index->mapped = true;
+
+    Indexheader* header = (Indexheader*)index->data;
+    bool ok = memcmp(header->magic, INDEX_MAGIC, 4) == 0
+        && header->version == INDEX_VERSION
+        && header->wad_size == wad_stat->st_size
+        && header->wad_mtime_sec == wad_stat->st_mtim.tv_sec
+        && header->wad_mtime_nsec == wad_stat->st_mtim.tv_nsec
+        && memcmp(&header->wad_header, &wadinfo->header, sizeof(Header)) == 0
+        && header->hash_size > 0 && header->num_maps >= 0
+        && index_size(header->wad_header.num_lumps, header->hash_size, header->num_maps) == (size_t)st.st_size;
+    if (ok) {
+        set_pointers(index);
+        ok = index_checksum(index, st.st_size) == header->checksum;
+    }
+    if (!ok) {
+        free_index(index);
+        return NULL;
+    }
+    return index;
+}
+
+// map lumps follow their marker, see find_map()
+static int map_lumps(Direntry* directory, int num_lumps, int marker, Direntry* lumpdir) {
+    int count = 0;
+    for (int i=0; i<NUM_MAP_LUMPS; ++i) {
+        lumpdir[i].filepos = 0;
+        lumpdir[i].size    = -1;
+    }
+    for (int j=marker+1; j<num_lumps; ++j) {
+        int lump = map_lump_index(directory[j].name);
+        if (lump < 0) break;
+        lumpdir[lump] = directory[j];
+        count++;
+    }
+    return count;
+}
+
+static bool index_map(Wadinfo* wadinfo, Mapindex* map) {
+    map->num_linedefs = map->lumpdir[LUMP_LINEDEFS].size > 0 ? map->lumpdir[LUMP_LINEDEFS].size / sizeof(Linedef) : 0;
+    map->num_things   = map->lumpdir[LUMP_THINGS].size > 0 ? map->lumpdir[LUMP_THINGS].size / sizeof(Thing) : 0;
+    map->num_vertexes = 0;
+    map->min_x = map->min_y = map->max_x = map->max_y = 0;
+    if (map->lumpdir[LUMP_VERTEXES].size <= 0) return true;
+
+    Vertex* vertexes = read_lump(wadinfo->wadfile, &map->lumpdir[LUMP_VERTEXES], NULL);
+    if (vertexes == NULL) return false;
+    map->num_vertexes = map->lumpdir[LUMP_VERTEXES].size / sizeof(Vertex);
+    map->min_x = map->max_x = vertexes[0].x;
+    map->min_y = map->max_y = vertexes[0].y;
+    generate_minmax(&map->max_x, &map->min_x, &map->max_y, &map->min_y, vertexes, map->num_vertexes);
+    free(vertexes);
+    return true;
+}
+
+// builds the index from the WAD and writes it next to it (a failed write
+// only costs the next run a rebuild)
+static Wadindex* build_index(Wadinfo* wadinfo, struct stat* wad_stat) {
+    if (!read_directory(wadinfo)) return NULL;
+    int num_lumps = wadinfo->header.num_lumps;
+    Direntry* directory = wadinfo->directory;
+    Direntry lumpdir[NUM_MAP_LUMPS];
+    int num_maps = 0;
+    // the map lumps themselves are skipped, only their marker gets a record:
+    for (int i=0; i<num_lumps; ++i) {
+        int count = map_lumps(directory, num_lumps, i, lumpdir);
+        if (count > 0) num_maps++;
+        i += count;
+    }
+    int hash_size = 16;
+    while (hash_size < 2 * num_lumps) hash_size *= 2;
+
+    size_t size = index_size(num_lumps, hash_size, num_maps);
+    Wadindex* index = malloc(sizeof(Wadindex));
+    index->data   = calloc(1, size);
+    index->size   = size;
+    index->mapped = false;
+    Indexheader* header = (Indexheader*)index->data;
+    memcpy(header->magic, INDEX_MAGIC, 4);
+    header->version        = INDEX_VERSION;
+    header->wad_size       = wad_stat->st_size;
+    header->wad_mtime_sec  = wad_stat->st_mtim.tv_sec;
+    header->wad_mtime_nsec = wad_stat->st_mtim.tv_nsec;
+    header->wad_header     = wadinfo->header;
+    header->hash_size      = hash_size;
+    header->num_maps       = num_maps;
+    set_pointers(index);
+
+    memcpy(index->directory, directory, num_lumps * sizeof(Direntry));
+    memset(index->lump_hash, -1, hash_size * sizeof(int));
+    for (int i=0; i<num_lumps; ++i) {
+        for (unsigned int h=hash_lump_name(directory[i].name); ; ++h) {
+            int* slot = &index->lump_hash[h & (hash_size - 1)];
+            if (*slot < 0) {
+                *slot = i;
+                break;
+            }
+            if (strncmp(directory[*slot].name, directory[i].name, 8) == 0) break;
+        }
+    }
+    for (int i=0, n=0; i<num_lumps; ++i) {
+        int count = map_lumps(directory, num_lumps, i, lumpdir);
+        if (count == 0) continue;
+        Mapindex* map = &index->maps[n];
+        memcpy(map->lumpdir, lumpdir, sizeof(lumpdir));
+        map->lump = i;
+        if (!index_map(wadinfo, map)) {
+            free_index(index);
+            return NULL;
+        }
+        n++;
+        i += count;
+    }
+    header->checksum = index_checksum(index, size);
+
+    // write to a unique temporary file first, so neither a concurrent reader
+    // nor a second builder ever sees half an index:
+    char* name = index_filename(wadinfo->filename);
+    char* tmp_name = malloc(strlen(name) + 8);
+    sprintf(tmp_name, "%s.XXXXXX", name);
+    int fd = mkstemp(tmp_name);
+    FILE* fh = NULL;
+    if (fd >= 0) {
+        // mkstemp() creates it 0600, the index is as readable as any other file:
+        mode_t mask = umask(0);
+        umask(mask);
+        fchmod(fd, 0666 & ~mask);
+        fh = fdopen(fd, "wb");
+        if (fh == NULL) close(fd);
+    }
+    bool written = fh && fwrite(index->data, 1, size, fh) == size;
+    if (fh && fclose(fh) != 0) written = false;
+    if (written && rename(tmp_name, name) != 0) written = false;
+    if (!written) {
+        fprintf(stderr, "could not write index %s: %s\n", name, strerror(errno));
+        if (fd >= 0) remove(tmp_name);
+    }
+    free(tmp_name);
+    free(name);
+    return index;
+}
+
+// sets wadinfo->index, building the index if it is missing or outdated
+bool open_index(Wadinfo* wadinfo, bool verbose) {
+    struct stat wad_stat;
+    if (stat(wadinfo->filename, &wad_stat) != 0) {
+        fprintf(stderr, "open_index(): %s: %s\n", wadinfo->filename, strerror(errno));
+        return false;
+    }
+    Wadindex* index = load_index(wadinfo, &wad_stat);
+    if (index == NULL) {
+        if (verbose) fprintf(stderr, "building index for %s\n", wadinfo->filename);
+        index = build_index(wadinfo, &wad_stat);
+        if (index == NULL) return false;
+    }
+    wadinfo->index = index;
+    return true;
+}
+
+// a copy of the lump directory, for read_directory()
+Direntry* index_directory(Wadindex* index) {
+    size_t size = index->header->wad_header.num_lumps * sizeof(Direntry);
+    Direntry* directory = malloc(size + 1);
+    memcpy(directory, index->directory, size);
+    return directory;
+}
+
+// directory index of the first lump called name, -1 if there is none
+int index_find_lump(Wadindex* index, const char* name) {
+    int mask = index->header->hash_size - 1;
+    for (unsigned int h=hash_lump_name(name); ; ++h) {
+        int slot = index->lump_hash[h & mask];
+        if (slot < 0) return -1;
+        if (strncmp(index->directory[slot].name, name, 8) == 0) return slot;
+    }
+}
+
+// find_map() through the index
+bool index_find_map(Wadinfo* wadinfo) {
+    Wadindex* index = wadinfo->index;
+    init_lumps(wadinfo);
+    int lump = index_find_lump(index, wadinfo->mapname);
+    if (lump < 0) return false;
+    // the records are sorted by lump:
+    int lo = 0, hi = index->header->num_maps - 1;
+    while (lo <= hi) {
+        int mid = (lo + hi) / 2;
+        if (index->maps[mid].lump < lump) {
+            lo = mid + 1;
+        }
+        else if (index->maps[mid].lump > lump) {
+            hi = mid - 1;
+        }
+        else {
+            memcpy(wadinfo->lumpdir, index->maps[mid].lumpdir, sizeof(wadinfo->lumpdir));
+            wadinfo->map_index = mid;
+            return true;
+        }
+    }
+    // a lump with that name, but no map lumps behind it (like find_map()):
+    return true;
+}
+
+// the bounds of the current map, false if they aren't indexed
+bool index_bounds(Wadinfo* wadinfo, int* max_x, int* min_x, int* max_y, int* min_y) {
+    if (wadinfo->index == NULL || wadinfo->map_index < 0) return false;
+    Mapindex* map = &wadinfo->index->maps[wadinfo->map_index];
+    if (map->num_vertexes == 0) return false;
+    *max_x = map->max_x;
+    *min_x = map->min_x;
+    *max_y = map->max_y;
+    *min_y = map->min_y;
+    return true;
+}
+
+// list_maps() output from the index
+void index_list_maps(Wadinfo* wadinfo) {
+    Wadindex* index = wadinfo->index;
+    char entrystring[9];
+    int num_maps = 0;
+    printf("Reading %s (%d lumps)...\n", wadinfo->filename, wadinfo->header.num_lumps);
+    // the same lumps as list_maps() finds, with or without map lumps behind them:
+    for (int i=0; i<wadinfo->header.num_lumps; ++i) {
+        Direntry* direntry = &index->directory[i];
+        if (!is_map_name(direntry->name)) continue;
+        num_maps++;
+        strncpy(entrystring, direntry->name, 8);
+        entrystring[8] = '\0';
+        printf("%d: %s (pos: %d, size: %d)\n", i, entrystring, direntry->filepos, direntry->size);
+    }
+    printf("%d map%s found\n", num_maps, num_maps!=1 ? "s" : "");
+}
+
+void free_index(Wadindex* index) {
+    if (index == NULL) return;
+    if (index->mapped) {
+        munmap(index->data, index->size);
+    }
+    else {
+        free(index->data);
+    }
+    free(index);
+}
@@ -0,0 +1,130 @@
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include "map2img.h"
+
+// lazy access to the lumps of one map: find_map() only records where the
+// lumps are, every lump is read on its first get_lump() and then stays
+// cached until free_lumps(). Output stages declare what they need as a
+// mask of NEED(LUMP_...) bits, see load_lumps().
+
+const char* map_lump_names[NUM_MAP_LUMPS] = {
+    [LUMP_THINGS]   = "THINGS",
+    [LUMP_LINEDEFS] = "LINEDEFS",
+    [LUMP_SIDEDEFS] = "SIDEDEFS",
+    [LUMP_VERTEXES] = "VERTEXES",
+    [LUMP_SEGS]     = "SEGS",
+    [LUMP_SSECTORS] = "SSECTORS",
+    [LUMP_NODES]    = "NODES",
+    [LUMP_SECTORS]  = "SECTORS",
+    [LUMP_REJECT]   = "REJECT",
+    [LUMP_BLOCKMAP] = "BLOCKMAP",
+    [LUMP_BEHAVIOR] = "BEHAVIOR",
+};
+
+// name is an 8 character lump name, returns -1 if it is not part of a map
+int map_lump_index(const char* name) {
+    for (int i=0; i<NUM_MAP_LUMPS; ++i) {
+        if (strncmp(name, map_lump_names[i], 8) == 0) return i;
+    }
+    return -1;
+}
+
+void init_lumps(Wadinfo* wadinfo) {
+    for (int i=0; i<NUM_MAP_LUMPS; ++i) {
+        wadinfo->lumpdir[i].filepos = 0;
+        wadinfo->lumpdir[i].size    = -1;
+        wadinfo->lumps[i]           = NULL;
+    }
+    wadinfo->linedefs      = NULL;
+    wadinfo->vertexes      = NULL;
+    wadinfo->things        = NULL;
+    wadinfo->sidedefs      = NULL;
+    wadinfo->sectors       = NULL;
+    wadinfo->num_linedefs  = 0;
+    wadinfo->num_vertexes  = 0;
+    wadinfo->num_things    = 0;
+    wadinfo->num_sidedefs  = 0;
+    wadinfo->num_sectors   = 0;
+    wadinfo->line_classes  = NULL;
+    wadinfo->thing_classes = NULL;
+    wadinfo->line_order    = NULL;
+    wadinfo->thing_order   = NULL;
+    wadinfo->map_index     = -1;
+}
+
+// reads any lump of the WAD into a new buffer, allocated from arena or
+// (arena NULL) with malloc()
+void* read_lump(FILE* wadfile, Direntry* direntry, Arena* arena) {
+    char name[9] = { 0 };
+    strncpy(name, direntry->name, 8);
+    int res = fseek(wadfile, direntry->filepos, SEEK_SET);
+    if (res < 0) {
+        fprintf(stderr, "read_lump(): fseek %s failed: %s\n", name, strerror(errno));
+        return NULL;
+    }
+    // + 1 so empty lumps still get a (cacheable) pointer:
+    void* data = arena ? arena_alloc(arena, direntry->size + 1) : malloc(direntry->size + 1);
+    if (data == NULL) return NULL;
+    size_t bytes_read = fread(data, 1, direntry->size, wadfile);
+    if (bytes_read != direntry->size) {
+        fprintf(stderr, "read_lump(): fread %s failed (got %zu, expected %zu bytes)!\n", name, bytes_read, (size_t)direntry->size);
+        if (!arena) free(data);
+        return NULL;
+    }
+    return data;
+}
+
+void* get_lump(Wadinfo* wadinfo, Maplump lump) {
+    if (wadinfo->lumps[lump]) return wadinfo->lumps[lump];
+
+    Direntry* d = &wadinfo->lumpdir[lump];
+    if (d->size < 0) {
+        fprintf(stderr, "get_lump(): %s has no %s lump!\n", wadinfo->mapname, map_lump_names[lump]);
+        return NULL;
+    }
+    void* data = read_lump(wadinfo->wadfile, d, wadinfo->arena);
+    if (data == NULL) return NULL;
+    wadinfo->lumps[lump] = data;
+
+    switch(lump) {
+        case LUMP_THINGS:
+            wadinfo->things     = data;
+            wadinfo->num_things = d->size/sizeof(Thing);
+            break;
+        case LUMP_LINEDEFS:
+            wadinfo->linedefs     = data;
+            wadinfo->num_linedefs = d->size/sizeof(Linedef);
+            break;
+        case LUMP_VERTEXES:
+            wadinfo->vertexes     = data;
+            wadinfo->num_vertexes = d->size/sizeof(Vertex);
+            break;
+        case LUMP_SIDEDEFS:
+            wadinfo->sidedefs     = data;
+            wadinfo->num_sidedefs = d->size/sizeof(Sidedef);
+            break;
+        case LUMP_SECTORS:
+            wadinfo->sectors     = data;
+            wadinfo->num_sectors = d->size/sizeof(Sector);
+            break;
+        default:
+            break;
+    }
+    return data;
+}
+
+bool load_lumps(Wadinfo* wadinfo, unsigned int needs) {
+    for (int i=0; i<NUM_MAP_LUMPS; ++i) {
+        if ((needs & NEED(i)) && get_lump(wadinfo, i) == NULL) return false;
+    }
+    return true;
+}
+
+// everything of the map is in the arena, so this is one arena_reset()
+void free_lumps(Wadinfo* wadinfo) {
+    arena_reset(wadinfo->arena);
+    init_lumps(wadinfo);
+}
@@ -4,59 +4,69 @@
 #include <stdlib.h>
 #include "map2img.h"
 #include <errno.h>
+#include <strings.h>
 
 #define ARG_IMPLEMENTATION
 #include "args.h"
 
-void output_svg(Imginfo* imginfo, Wadinfo* wadinfo, FILE* output, bool verbose, Header* wadheader);
+// reads the whole lump directory with one fread (or takes it from the
+// index), it stays in wadinfo->directory for every following find_map()
+bool read_directory(Wadinfo* wadinfo) {
+    if (wadinfo->directory) return true;
+    if (wadinfo->index) {
+        wadinfo->directory = index_directory(wadinfo->index);
+        return true;
+    }
+    Header* header = &wadinfo->header;
+    // a damaged header must not make us allocate gigabytes (works for
+    // the in-memory pk3 maps, too):
+    if (fseek(wadinfo->wadfile, 0, SEEK_END) < 0) {
+        fprintf(stderr, "read_directory(): %s\n", strerror(errno));
+        return false;
+    }
+    long int file_size = ftell(wadinfo->wadfile);
+    if (header->num_lumps < 0 || header->infotableofs < 0 ||
+            (size_t)header->infotableofs + (size_t)header->num_lumps * sizeof(Direntry) > (size_t)file_size) {
+        fprintf(stderr, "read_directory(): lump directory of %s is outside of the file!\n", wadinfo->filename);
+        return false;
+    }
+    int res = fseek(wadinfo->wadfile, header->infotableofs, SEEK_SET);
+    if (res < 0) {
+        fprintf(stderr, "read_directory(): %s\n", strerror(errno));
+        return false;
+    }
+    Direntry* direntries = malloc(header->num_lumps * sizeof(Direntry) + 1);
+    if (direntries == NULL) {
+        fprintf(stderr, "read_directory(): out of memory for %d lumps!\n", header->num_lumps);
+        return false;
+    }
+    size_t bytes_read = fread(direntries, sizeof(Direntry), header->num_lumps, wadinfo->wadfile);
+    if (bytes_read != header->num_lumps) {
+        fprintf(stderr, "read_directory(): Direntry read failed, got %zu, expected %d entries!\n", bytes_read, header->num_lumps);
+        free(direntries);
+        return false;
+    }
+    wadinfo->directory = direntries;
+    return true;
+}
 
-bool find_map(FILE* wadfile, Direntry* direntry, Direntry* d_vertexes, Direntry* d_linedefs, Direntry* d_things, char* mapname, int num_lumps, int infotableofs) {
-    int res;
-    for (int i=0; i<num_lumps; ++i) {
-        res = fseek(wadfile, infotableofs+(i*sizeof(Direntry)), SEEK_SET);
-        if (res < 0) {
-            fprintf(stderr, "find_map(): %s\n", strerror(errno));
-            return false;
-        }
-        size_t bytes_read;
-        bytes_read = fread(direntry, 1, sizeof(Direntry), wadfile);
-        if (bytes_read != sizeof(Direntry)) {
-            fprintf(stderr, "find_map(): Direntry read failed, got %zu, expected %zu bytes!\n", bytes_read, sizeof(Direntry));
-            return false;
-        }
-        if (strncmp(direntry->name, mapname, strlen(mapname)) == 0) {
-            // Things are listed right after the mapname:
-            res = fseek(wadfile, infotableofs+((i+1)*sizeof(Direntry)), SEEK_SET);
-            if (res < 0) {
-                fprintf(stderr, "find_map() - things: %s\n", strerror(errno));
-                return false;
-            }
-            bytes_read = fread(d_things, 1, sizeof(Direntry), wadfile);
-            if (bytes_read != sizeof(Direntry)) {
-                fprintf(stderr, "find_map(): Direntry things read failed, got %zu, expected %zu bytes!\n", bytes_read, sizeof(Direntry));
-                return false;
-            }
-            // Linedefs come 2 entries after mapname:
-            res = fseek(wadfile, infotableofs+((i+2)*sizeof(Direntry)), SEEK_SET);
-            if (res < 0) {
-                fprintf(stderr, "find_map() - linedefs: %s\n", strerror(errno));
-                return false;
-            }
-            bytes_read = fread(d_linedefs, 1, sizeof(Direntry), wadfile);
-            if (bytes_read != sizeof(Direntry)) {
-                fprintf(stderr, "find_map(): Direntry linedefs read failed, got %zu, expected %zu bytes!\n", bytes_read, sizeof(Direntry));
-                return false;
-            }
-            // Vertexes are 4 after mapname:
-            res = fseek(wadfile, infotableofs+((i+4)*sizeof(Direntry)), SEEK_SET);
-            if (res < 0) {
-                fprintf(stderr, "find_map() - vertexes: %s\n", strerror(errno));
-                return false;
-            }
-            bytes_read = fread(d_vertexes, 1, sizeof(Direntry), wadfile);
-            if (bytes_read != sizeof(Direntry)) {
-                fprintf(stderr, "find_map(): Direntry vertexes read failed, got %zu, expected %zu bytes!\n", bytes_read, sizeof(Direntry));
-                return false;
+// looks up the map in the lump directory and records the position of its
+// lumps (everything up to the next lump that doesn't belong to a map). In
+// a pk3 the file names the map, so the first marker is taken there.
+bool find_map(Wadinfo* wadinfo) {
+    if (wadinfo->index) return index_find_map(wadinfo);
+    if (!read_directory(wadinfo)) return false;
+    Direntry* direntries = wadinfo->directory;
+    init_lumps(wadinfo);
+    for (int i=0; i<wadinfo->header.num_lumps; ++i) {
+        bool marker = wadinfo->pk3_map
+            ? i+1 < wadinfo->header.num_lumps && map_lump_index(direntries[i+1].name) >= 0
+            : strncmp(direntries[i].name, wadinfo->mapname, 8) == 0;
+        if (marker) {
+            for (int j=i+1; j<wadinfo->header.num_lumps; ++j) {
+                int lump = map_lump_index(direntries[j].name);
+                if (lump < 0) break;
+                wadinfo->lumpdir[lump] = direntries[j];
             }
             return true;
         }
@@ -81,7 +91,26 @@ void generate_offsets(int* x_off, int* y_off, int min_x, int min_y) {
     if (min_y>0) *y_off = min_y;
 }
 
-bool list_maps(char* filename) {
+// identification is the (not terminated) 4 character header field
+bool is_wad_ident(const char* identification) {
+    return strncmp(identification, "IWAD", 4) == 0 || strncmp(identification, "PWAD", 4) == 0;
+}
+
+// name is a (not necessarily terminated) 8 character lump name
+bool is_map_name(const char* name) {
+    if (strnlen(name, 8) < 4) return false;
+    if (strncmp(name, "MAP", 3) == 0 && name[3]>47 && name[3]<58) {
+        // DOOM 2
+        return true;
+    }
+    if (name[0] == 'E' && name[2] == 'M' && name[1]>47 && name[1]<58) {
+        // DOOM 1
+        return true;
+    }
+    return false;
+}
+
+bool list_maps(char* filename, bool use_index) {
     FILE* fh = fopen(filename, "r");
     if (fh == NULL) {
         fprintf(stderr, "ERROR: Could not open %s!\n", filename);
@@ -95,8 +124,30 @@ bool list_maps(char* filename) {
         fprintf(stderr, "list_maps() fread wadheader failed (got %zu, expected %zu bytes)!\n", bytes_read, sizeof(wadheader));
         return false;
     }
+    if (is_pk3(&wadheader)) {
+        bool ok = list_pk3_maps(fh, filename);
+        fclose(fh);
+        return ok;
+    }
+    if (use_index) {
+        Wadinfo wadinfo = { 0 };
+        wadinfo.filename = filename;
+        wadinfo.header   = wadheader;
+        wadinfo.wadfile  = fh;
+        bool ok = open_index(&wadinfo, false);
+        if (ok) index_list_maps(&wadinfo);
+        free_index(wadinfo.index);
+        free(wadinfo.directory);
+        fclose(fh);
+        return ok;
+    }
 
     Direntry *direntry = malloc(wadheader.num_lumps * sizeof(Direntry));
+    if (direntry == NULL) {
+        fprintf(stderr, "list_maps(): out of memory for %d lumps!\n", wadheader.num_lumps);
+        fclose(fh);
+        return false;
+    }
 
     int num_maps = 0;
 
@@ -111,27 +162,16 @@ bool list_maps(char* filename) {
             return false;
         }
         bytes_read = fread(&direntry[x], 1, sizeof(Direntry), fh);
-        if (bytes_read != sizeof(wadheader)) {
+        if (bytes_read != sizeof(Direntry)) {
             fprintf(stderr, "list_maps() fread Direntry failed (got %zu, expected %zu bytes)!\n", bytes_read, sizeof(Direntry));
             return false;
         }
 
-        if (strnlen(direntry[x].name, 8) >= 4) {
-            bool ismap = false;
-            char* n = direntry[x].name;
-            if (strncmp(n, "MAP", 3) == 0 && n[3]>47 && n[3]<58) {
-                // DOOM 2
-                ismap = true;
-            }
-            if (n[0] == 'E' && n[2] == 'M' && n[1]>47 && n[1]<58) {
-                // DOOM 1
-                ismap = true;
-            }
-            if (ismap) {
-                num_maps++;
-                strncpy(entrystring, n, 8);
-                printf("%d: %s (pos: %d, size: %d)\n", x, entrystring, direntry[x].filepos, direntry[x].size);
-            }
+        if (is_map_name(direntry[x].name)) {
+            num_maps++;
+            strncpy(entrystring, direntry[x].name, 8);
+            entrystring[8] = '\0';
+            printf("%d: %s (pos: %d, size: %d)\n", x, entrystring, direntry[x].filepos, direntry[x].size);
         }
     }
     printf("%d map%s found\n", num_maps, num_maps!=1 ? "s" : "");
@@ -140,27 +180,328 @@ bool list_maps(char* filename) {
     return true;
 }
 
+// splits a comma separated list in place, items points into list afterwards
+int split_list(char* list, char*** items) {
+    int count = 1;
+    for (char* c=list; *c; ++c) {
+        if (*c == ',') count++;
+    }
+    *items = malloc(count * sizeof(char*));
+    int i = 0;
+    (*items)[i++] = list;
+    for (char* c=list; *c; ++c) {
+        if (*c == ',') {
+            *c = '\0';
+            (*items)[i++] = c+1;
+        }
+    }
+    return count;
+}
+
+Format output_format(const char* filename) {
+    const char* ext = filename ? strrchr(filename, '.') : NULL;
+    if (ext && (strcasecmp(ext, ".html") == 0 || strcasecmp(ext, ".htm") == 0)) return FORMAT_HTML;
+    if (ext && strcasecmp(ext, ".png") == 0) return FORMAT_PNG;
+    return FORMAT_SVG;
+}
+
+// pairs up the -s and -o lists, a single scale or file name is used for
+// every output. Returns the number of outputs or 0 on error.
+int build_outputs(char* scale_arg, char* output_arg, Output** outputs) {
+    char** scales    = NULL;
+    char** filenames = NULL;
+    int num_scales    = scale_arg ? split_list(scale_arg, &scales) : 0;
+    int num_filenames = output_arg ? split_list(output_arg, &filenames) : 0;
+    int num_outputs   = num_scales > num_filenames ? num_scales : num_filenames;
+    if (num_outputs == 0) num_outputs = 1;
+
+    if (num_scales > 1 && num_filenames != num_scales) {
+        fprintf(stderr, "ERROR: %d scales given, but %d output files (need one -o name per scale)!\n", num_scales, num_filenames);
+        num_outputs = 0;
+    }
+    *outputs = malloc(num_outputs * sizeof(Output));
+    for (int i=0; i<num_outputs; ++i) {
+        (*outputs)[i].filename = num_filenames ? filenames[i] : NULL;
+        (*outputs)[i].scale    = 0.5;
+        (*outputs)[i].format   = output_format((*outputs)[i].filename);
+        if (num_scales) {
+            char* scale = scales[num_scales > 1 ? i : 0];
+            char* end;
+            (*outputs)[i].scale = strtod(scale, &end);
+            if (end == scale || *end != '\0' || (*outputs)[i].scale <= 0) {
+                fprintf(stderr, "ERROR: invalid scale factor '%s'!\n", scale);
+                num_outputs = 0;
+                break;
+            }
+        }
+    }
+    free(scales);
+    free(filenames);
+    return num_outputs;
+}
+
+// replaces %m in the output file name with the map name
+char* expand_filename(const char* filename, const char* mapname) {
+    size_t len = strlen(filename) + 1;
+    for (const char* c=strstr(filename, "%m"); c; c=strstr(c+2, "%m")) {
+        len += strlen(mapname);
+    }
+    char* expanded = malloc(len);
+    char* out = expanded;
+    while (*filename) {
+        if (filename[0] == '%' && filename[1] == 'm') {
+            out += sprintf(out, "%s", mapname);
+            filename += 2;
+        }
+        else {
+            *out++ = *filename++;
+        }
+    }
+    *out = '\0';
+    return expanded;
+}
+
+// the maps to render: -m is a comma separated list, * means every map
+int collect_mapnames(Wadinfo* wadinfo, char*** mapnames) {
+    if (strcmp(wadinfo->mapname, "*") != 0) {
+        char* list = strdup(wadinfo->mapname);
+        return split_list(list, mapnames);
+    }
+    if (!read_directory(wadinfo)) {
+        *mapnames = NULL;
+        return 0;
+    }
+    int num_maps = 0;
+    for (int i=0; i<wadinfo->header.num_lumps; ++i) {
+        if (is_map_name(wadinfo->directory[i].name)) num_maps++;
+    }
+    // one block for the pointers and the names, like split_list():
+    char* names = calloc(num_maps + 1, 9);
+    *mapnames = malloc((num_maps + 1) * sizeof(char*));
+    // [0] owns the block even without any maps, see free_mapnames():
+    (*mapnames)[0] = names;
+    for (int i=0, n=0; i<wadinfo->header.num_lumps; ++i) {
+        if (!is_map_name(wadinfo->directory[i].name)) continue;
+        (*mapnames)[n] = names + 9*n;
+        strncpy((*mapnames)[n], wadinfo->directory[i].name, 8);
+        n++;
+    }
+    if (num_maps == 0) {
+        fprintf(stderr, "no maps found in %s!\n", wadinfo->filename);
+    }
+    return num_maps;
+}
+
+void free_mapnames(char** mapnames) {
+    if (mapnames) free(mapnames[0]);
+    free(mapnames);
+}
+
+// bounds of the loaded map, then every output in its format
+bool write_outputs(Wadinfo* wadinfo, Imginfo* imginfo, Output* outputs, int num_outputs, bool verbose) {
+    if (wadinfo->num_vertexes == 0) {
+        fprintf(stderr, "%s has no vertexes!\n", wadinfo->mapname);
+        return false;
+    }
+
+    // SVG stuff:
+    int max_x = wadinfo->vertexes[0].x;
+    int min_x = wadinfo->vertexes[0].x;
+    int max_y = wadinfo->vertexes[0].y;
+    int min_y = wadinfo->vertexes[0].y;
+    imginfo->x_off = 0;
+    imginfo->y_off = 0;
+    if (!index_bounds(wadinfo, &max_x, &min_x, &max_y, &min_y)) {
+        generate_minmax(&max_x, &min_x, &max_y, &min_y, wadinfo->vertexes, wadinfo->num_vertexes);
+    }
+    generate_offsets(&imginfo->x_off, &imginfo->y_off, min_x, min_y);
+    imginfo->width  = max_x + imginfo->x_off;
+    imginfo->height = max_y + imginfo->y_off;
+    imginfo->max_x  = max_x;
+    imginfo->max_y  = max_y;
+    if (imginfo->hilbert && !order_map(wadinfo)) {
+        return false;
+    }
+
+    // everything above is shared, only the scale differs per output:
+    bool ok = true;
+    for (int i=0; i<num_outputs; ++i) {
+        FILE* output = stdout;
+        char* filename = NULL;
+        if (outputs[i].filename) {
+            filename = expand_filename(outputs[i].filename, wadinfo->mapname);
+            output = fopen(filename, outputs[i].format == FORMAT_PNG ? "wb" : "w");
+            if (!output) {
+                fprintf(stderr, "ERROR, could not open output file %s\n", filename);
+                free(filename);
+                ok = false;
+                continue;
+            }
+        }
+        imginfo->scale = outputs[i].scale;
+        switch (outputs[i].format) {
+            case FORMAT_HTML:
+                output_html(imginfo, wadinfo, output);
+                break;
+            case FORMAT_PNG:
+                if (!output_png(imginfo, wadinfo, output)) {
+                    ok = false;
+                    // nothing was written, don't leave an empty file behind:
+                    if (filename) {
+                        fclose(output);
+                        remove(filename);
+                        free(filename);
+                        continue;
+                    }
+                }
+                break;
+            default:
+                output_svg(imginfo, wadinfo, output, verbose, &wadinfo->header);
+                break;
+        }
+        if (filename) {
+            fclose(output);
+            free(filename);
+        }
+    }
+    return ok;
+}
+
+// loads wadinfo->mapname and writes every output for it
+bool render_map(Wadinfo* wadinfo, Imginfo* imginfo, Output* outputs, int num_outputs, bool verbose) {
+    if (!find_map(wadinfo)) {
+        fprintf(stderr, "%s not found in %s!\n", wadinfo->mapname, wadinfo->filename);
+        return false;
+    }
+    // only read what the outputs actually draw:
+    unsigned int needs = 0;
+    for (int i=0; i<num_outputs; ++i) {
+        switch (outputs[i].format) {
+            case FORMAT_HTML: needs |= output_html_needs(imginfo); break;
+            case FORMAT_PNG:  needs |= output_png_needs(imginfo); break;
+            default:          needs |= output_svg_needs(imginfo); break;
+        }
+    }
+    bool ok = load_lumps(wadinfo, needs);
+    if (ok) {
+        ok = classify_map(wadinfo) && write_outputs(wadinfo, imginfo, outputs, num_outputs, verbose);
+    }
+    free_lumps(wadinfo);
+    return ok;
+}
+
+// diff mode: renders wadinfo->mapname with the changes against old_wad
+bool render_diff(Wadinfo* wadinfo, Wadinfo* old_wad, Imginfo* imginfo, Output* outputs, int num_outputs, bool verbose) {
+    old_wad->mapname = wadinfo->mapname;
+    if (!find_map(wadinfo) || !find_map(old_wad)) {
+        fprintf(stderr, "%s not found in %s and %s!\n", wadinfo->mapname, wadinfo->filename, old_wad->filename);
+        return false;
+    }
+    Wadinfo diff;
+    bool ok = load_lumps(wadinfo, output_svg_needs(imginfo))
+        && load_lumps(old_wad, output_svg_needs(imginfo))
+        && diff_maps(old_wad, wadinfo, &diff, verbose);
+    if (ok) {
+        Imginfo diffinfo = *imginfo;
+        diffinfo.linestyles      = diff_linestyles;
+        diffinfo.thingstyles     = diff_thingstyles;
+        diffinfo.num_linestyles  = NUM_DIFF_CLASSES;
+        diffinfo.num_thingstyles = NUM_DIFF_CLASSES;
+        ok = write_outputs(&diff, &diffinfo, outputs, num_outputs, verbose);
+    }
+    free_lumps(wadinfo);
+    free_lumps(old_wad);
+    return ok;
+}
+
+// opens wadinfo->filename and reads its header. For a pk3 the map WAD
+// maps/<mapname>.wad is inflated into *pk3_buffer and read from there.
+bool open_wad(Wadinfo* wadinfo, unsigned char** pk3_buffer) {
+    *pk3_buffer = NULL;
+    FILE* wadfile = fopen(wadinfo->filename, "rb");
+    if (wadfile == NULL) {
+        fprintf(stderr, "Could not open %s!\n", wadinfo->filename);
+        return false;
+    }
+
+    // read the header:
+    size_t bytes_read;
+    bytes_read = fread(&wadinfo->header, 1, sizeof(Header), wadfile);
+    if (bytes_read != sizeof(Header)) {
+        fprintf(stderr, "fread Header failed (got %zu, expected %zu bytes)!\n", bytes_read, sizeof(Header));
+        fclose(wadfile);
+        return false;
+    }
+
+    if (is_pk3(&wadinfo->header)) {
+        if (wadinfo->mapname[0] == '\0' || strchr(wadinfo->mapname, ',') || strcmp(wadinfo->mapname, "*") == 0) {
+            fprintf(stderr, "ERROR: a single -m [mapname] is required for pk3 files!\n");
+            fclose(wadfile);
+            return false;
+        }
+        FILE* pk3 = wadfile;
+        wadfile = open_pk3_map(pk3, wadinfo->filename, wadinfo->mapname, pk3_buffer);
+        fclose(pk3);
+        if (wadfile == NULL) {
+            return false;
+        }
+        wadinfo->pk3_map = true;
+        bytes_read = fread(&wadinfo->header, 1, sizeof(Header), wadfile);
+        if (bytes_read != sizeof(Header)) {
+            fprintf(stderr, "fread Header failed (got %zu, expected %zu bytes)!\n", bytes_read, sizeof(Header));
+            fclose(wadfile);
+            free(*pk3_buffer);
+            return false;
+        }
+    }
+    strncpy(wadinfo->wad_ident, wadinfo->header.identification, 4);
+    wadinfo->wad_ident[4] = '\0';
+    if (!is_wad_ident(wadinfo->wad_ident)) {
+        fprintf(stderr, "ERROR, no wadfile (wad_ident: %s)\n", wadinfo->wad_ident);
+        fclose(wadfile);
+        free(*pk3_buffer);
+        return false;
+    }
+    wadinfo->wadfile = wadfile;
+    return true;
+}
+
 int main(int argc, char** argv) {
     bool verbose     = false;
-    Header wadheader;
-    Wadinfo wadinfo;
-    char wad_ident[5]   = "    ";
+    Wadinfo wadinfo = { 0 };
     Imginfo imginfo;
     imginfo.draw_things = false;
+    imginfo.compact     = false;
+    imginfo.raw         = false;
     imginfo.scale       = 0.5;
     imginfo.padding     = 0;
+    imginfo.hilbert     = false;
+    imginfo.threads     = 1;
+    imginfo.linestyles      = linestyles;
+    imginfo.thingstyles     = thingstyles;
+    imginfo.num_linestyles  = NUM_LINE_CLASSES;
+    imginfo.num_thingstyles = NUM_THING_CLASSES;
 
     // commandline arguments:
     arglist myarglist;
     init_list(&myarglist, argv[0], "converts a doom map to an svg image");
     add_arg(&myarglist, "-v", BOOL, "verbose output", false);
-    add_arg(&myarglist, "-f", STRING, "WAD file", true);
-    add_arg(&myarglist, "-m", STRING, "map name (e.g. E1M1)", false);
-    add_arg(&myarglist, "-o", STRING, "output file name", false);
+    add_arg(&myarglist, "-f", STRING, "WAD or PK3 file (required unless -c or --heatmap is set)", false);
+    add_arg(&myarglist, "-m", STRING, "map name (e.g. E1M1), comma separated list or * for all maps", false);
+    add_arg(&myarglist, "-o", STRING, "output file name(s), comma separated (one per scale), *.html writes an interactive viewer, *.png a textured raster image, %m is replaced by the map name", false);
     add_arg(&myarglist, "-l", BOOL, "lists all maps in the wad file and exits", false);
     add_arg(&myarglist, "-t", BOOL, "draw things", false);
-    add_arg(&myarglist, "-s", FLOAT, "scale factor (default: 0.5)", false);
+    add_arg(&myarglist, "-s", STRING, "scale factor(s), comma separated (default: 0.5)", false);
     add_arg(&myarglist, "-p", INTEGER, "additional padding from the image borders (default: 0)", false);
+    add_arg(&myarglist, "-k", BOOL, "compact svg (css classes and shared symbols instead of inline styles)", false);
+    add_arg(&myarglist, "-H", BOOL, "emit svg linedefs and things along a Hilbert curve (spatially local, compresses better)", false);
+    add_arg(&myarglist, "-r", BOOL, "raw map coordinates under one group transform (output independent of -s)", false);
+    add_arg(&myarglist, "--stats-only", BOOL, "write map statistics as JSON instead of an image (all maps if -m is not set)", false);
+    add_arg(&myarglist, "-c", STRING, "catalog all WADs below this directory as JSON Lines and exit", false);
+    add_arg(&myarglist, "--heatmap", STRING, "thing density heatmaps (png and raw floats per thing class) of all WADs below this directory, -o is the file name prefix (default: heatmap)", false);
+    add_arg(&myarglist, "-i", BOOL, "use a sidecar index <file>.m2i (written if it is missing or outdated)", false);
+    add_arg(&myarglist, "-d", STRING, "diff: older WAD to compare the map against (svg only, changes highlighted)", false);
+    add_arg(&myarglist, "-j", INTEGER, "number of worker threads, also used to format big svgs in parallel (default: number of CPUs)", false);
     if (!parse_args(&myarglist, argc, argv)) {
         fprintf(stderr, "Error parsing arguments!\n");
         print_help(&myarglist);
@@ -170,15 +511,12 @@ int main(int argc, char** argv) {
     wadinfo.filename      = get_string_val(&myarglist, "-f");
     wadinfo.mapname       = get_string_val(&myarglist, "-m");
     char* output_filename = NULL;
+    int num_threads       = pool_default_threads();
 
     if (is_set(&myarglist, "-p")) {
         imginfo.padding = get_int_val(&myarglist, "-p");
     }
 
-    if (is_set(&myarglist, "-s")) {
-        imginfo.scale = get_float_val(&myarglist, "-s");
-    }
-
     if (is_set(&myarglist, "-v")) {
         verbose = true;
         }
@@ -187,133 +525,166 @@ int main(int argc, char** argv) {
         imginfo.draw_things = true;
     }
 
+    if (is_set(&myarglist, "-k")) {
+        imginfo.compact = true;
+    }
+
+    if (is_set(&myarglist, "-r")) {
+        imginfo.raw = true;
+    }
+
+    if (is_set(&myarglist, "-H")) {
+        imginfo.hilbert = true;
+    }
+
     if (is_set(&myarglist, "-o")) {
         output_filename = get_string_val(&myarglist, "-o");
     }
-    
+
+    if (is_set(&myarglist, "-j")) {
+        num_threads = get_int_val(&myarglist, "-j");
+    }
+    imginfo.threads = num_threads;
+
+    if (is_set(&myarglist, "-c")) {
+        FILE* output = stdout;
+        if (output_filename) {
+            output = fopen(output_filename, "w");
+            if (!output) {
+                fprintf(stderr, "ERROR, could not open output file %s\n", output_filename);
+                free_args(&myarglist);
+                return 1;
+            }
+        }
+        bool ok = catalog_wads(get_string_val(&myarglist, "-c"), output, num_threads, verbose);
+        if (output_filename) fclose(output);
+        free_args(&myarglist);
+        return ok ? 0 : 1;
+    }
+
+    if (is_set(&myarglist, "--heatmap")) {
+        bool ok = heatmap_wads(get_string_val(&myarglist, "--heatmap"), output_filename ? output_filename : "heatmap", num_threads, verbose);
+        free_args(&myarglist);
+        return ok ? 0 : 1;
+    }
+
+    if (!is_set(&myarglist, "-f")) {
+        fprintf(stderr, "ERROR: -f [wadfile] has to be set!\n");
+        print_help(&myarglist);
+        free_args(&myarglist);
+        return 1;
+    }
+
+    bool use_index = is_set(&myarglist, "-i");
     if (is_set(&myarglist, "-l")) {
-        if (!list_maps(wadinfo.filename)) return 1;
+        if (!list_maps(wadinfo.filename, use_index)) return 1;
         free_args(&myarglist);
         return 0;
     }
 
-    if (!is_set(&myarglist, "-m")) {
-        fprintf(stderr, "ERROR: either -m [mapname] or -l has to be set!\n");
+    bool stats_only = is_set(&myarglist, "--stats-only");
+    if (!stats_only && !is_set(&myarglist, "-m")) {
+        fprintf(stderr, "ERROR: either -m [mapname], -l or --stats-only has to be set!\n");
         free_args(&myarglist);
         return 1;
     }
-    // End commandline arguments
 
-    FILE* wadfile = fopen(wadinfo.filename, "rb");
-    if (wadfile == NULL) {
-        fprintf(stderr, "Could not open %s!\n", wadinfo.filename);
+    Output* outputs;
+    int num_outputs = build_outputs(is_set(&myarglist, "-s") ? get_string_val(&myarglist, "-s") : NULL, output_filename, &outputs);
+    if (num_outputs == 0) {
+        free(outputs);
+        free_args(&myarglist);
         return 1;
     }
+    // End commandline arguments
 
-    // read the header:
-    size_t bytes_read;
-    bytes_read = fread(&wadheader, 1, sizeof(Header), wadfile);
-    if (bytes_read != sizeof(Header)) {
-        fprintf(stderr, "fread Header failed (got %zu, expected %zu bytes)!\n", bytes_read, sizeof(Header));
+    unsigned char* pk3_buffer = NULL;
+    if (!open_wad(&wadinfo, &pk3_buffer)) {
         return 1;
     }
-    strncpy(wadinfo.wad_ident, wadheader.identification, 4);
-    if (strcmp(wadinfo.wad_ident, "IWAD") != 0 && strcmp(wadinfo.wad_ident, "PWAD") != 0) {
-        fprintf(stderr, "ERROR, no wadfile (wad_ident: %s)\n", wadinfo.wad_ident);
+    wadinfo.arena = arena_create(1 << 20);
+    // maps inside a pk3 live in memory, there is nothing to index:
+    if (use_index && !pk3_buffer && !open_index(&wadinfo, verbose)) {
         return 1;
     }
 
-    Direntry direntry;
-    Direntry d_linedefs;
-    Direntry d_vertexes;
-    Direntry d_things;
-    if (find_map(wadfile, &direntry, &d_vertexes, &d_linedefs, &d_things, wadinfo.mapname, wadheader.num_lumps, wadheader.infotableofs)) {
-        FILE* output;
-        if (output_filename) {
-            output = fopen(output_filename, "w");
-            if (!output) {
-                fprintf(stderr, "ERROR, could not open output file %s\n", output_filename);
+    // -d: the older version to compare the map against
+    Wadinfo old_wad = { 0 };
+    unsigned char* old_pk3_buffer = NULL;
+    if (is_set(&myarglist, "-d")) {
+        for (int i=0; i<num_outputs; ++i) {
+            if (outputs[i].format != FORMAT_SVG) {
+                fprintf(stderr, "ERROR: diff mode (-d) only writes svg!\n");
                 return 1;
             }
         }
-        else {
-            output = stdout;
-        }
-
-        wadinfo.header    = wadheader;
-        wadinfo.linedefs  = malloc(d_linedefs.size);
-        wadinfo.vertexes  = malloc(d_vertexes.size);
-        wadinfo.things    = malloc(d_things.size);
-
-        int res;
-        res = fseek(wadfile, d_linedefs.filepos, SEEK_SET);
-        if (res < 0) {
-            fprintf(stderr, "fseek linedefs failed: %s\n", strerror(errno));
+        old_wad.filename = get_string_val(&myarglist, "-d");
+        old_wad.mapname  = wadinfo.mapname;
+        if (!open_wad(&old_wad, &old_pk3_buffer)) {
             return 1;
         }
-        bytes_read = fread(wadinfo.linedefs, 1, d_linedefs.size, wadfile);
-        if (bytes_read != d_linedefs.size) {
-            fprintf(stderr, "fread linedefs failed (got %zu, expected %zu bytes)!\n", bytes_read, (size_t)d_linedefs.size);
+        old_wad.arena = arena_create(1 << 20);
+        if (use_index && !old_pk3_buffer && !open_index(&old_wad, verbose)) {
             return 1;
         }
-        res = fseek(wadfile, d_vertexes.filepos, SEEK_SET);
-        if (res < 0) {
-            fprintf(stderr, "fseek vertexes failed: %s\n", strerror(errno));
-            return 1;
-        }
-        bytes_read = fread(wadinfo.vertexes, 1, d_vertexes.size, wadfile);
-        if (bytes_read != d_vertexes.size) {
-            fprintf(stderr, "fread vertexes failed (got %zu, expected %zu bytes)!\n", bytes_read, (size_t)d_vertexes.size);
-            return 1;
-        }
-        res = fseek(wadfile, d_things.filepos, SEEK_SET);
-        if (res < 0) {
-            fprintf(stderr, "fseek things failed: %s\n", strerror(errno));
-            return 1;
-        }
-        bytes_read = fread(wadinfo.things, 1, d_things.size, wadfile);
-        if (bytes_read != d_things.size) {
-            fprintf(stderr, "fread things failed (got %zu, expected %zu bytes)!\n", bytes_read, (size_t)d_things.size);
-            return 1;
-        }
-
+    }
 
-        wadinfo.num_vertexes = d_vertexes.size/sizeof(Vertex);
-        wadinfo.num_linedefs = d_linedefs.size/sizeof(Linedef);
-        wadinfo.num_things   = d_things.size/sizeof(Thing);
-
-        // SVG stuff:
-        int max_x = wadinfo.vertexes[0].x;
-        int min_x = wadinfo.vertexes[0].x;
-        int max_y = wadinfo.vertexes[0].y;
-        int min_y = wadinfo.vertexes[0].y;
-        imginfo.x_off = 0;
-        imginfo.y_off = 0;
-        generate_minmax(&max_x, &min_x, &max_y, &min_y, wadinfo.vertexes, wadinfo.num_vertexes);
-        generate_offsets(&imginfo.x_off, &imginfo.y_off, min_x, min_y);
-        imginfo.width  = max_x + imginfo.x_off;
-        imginfo.height = max_y + imginfo.y_off;
-        imginfo.max_x  = max_x;
-        imginfo.max_y  = max_y;
-            
-        output_svg(&imginfo, &wadinfo, output, verbose, &wadheader);
-
-        free(wadinfo.linedefs);
-        free(wadinfo.vertexes);
-        free(wadinfo.things);
-        if (output_filename) {
-            fclose(output);
+    if (stats_only) {
+        FILE* output = stdout;
+        if (outputs[0].filename) {
+            output = fopen(outputs[0].filename, "w");
+            if (!output) {
+                fprintf(stderr, "ERROR, could not open output file %s\n", outputs[0].filename);
+                return 1;
+            }
         }
+        bool ok = output_wad_stats(&wadinfo, output);
+        if (outputs[0].filename) fclose(output);
+        arena_free(wadinfo.arena);
+        free_index(wadinfo.index);
+        free(wadinfo.directory);
+        free(outputs);
+        free_args(&myarglist);
+        fclose(wadinfo.wadfile);
+        free(pk3_buffer);
+        return ok ? 0 : 1;
+    }
 
+    // -m can be a list of maps or * for all maps in the WAD:
+    char** mapnames;
+    int num_maps = collect_mapnames(&wadinfo, &mapnames);
+    if (num_maps > 1) {
+        for (int i=0; i<num_outputs; ++i) {
+            if (outputs[i].filename == NULL || strstr(outputs[i].filename, "%m") == NULL) {
+                fprintf(stderr, "ERROR: several maps need -o file names with %%m (replaced by the map name)!\n");
+                num_maps = 0;
+                break;
+            }
+        }
     }
-    else {
-        fprintf(stderr, "%s not found in %s!\n", wadinfo.mapname, wadinfo.filename);
-        free_args(&myarglist);
-        fclose(wadfile);
-        return 1;
+    bool ok = num_maps > 0;
+    for (int i=0; i<num_maps; ++i) {
+        wadinfo.mapname = mapnames[i];
+        bool rendered = old_wad.wadfile ? render_diff(&wadinfo, &old_wad, &imginfo, outputs, num_outputs, verbose)
+                                        : render_map(&wadinfo, &imginfo, outputs, num_outputs, verbose);
+        if (!rendered) ok = false;
     }
+    free_mapnames(mapnames);
 
+    free_flatcache(wadinfo.flats);
+    arena_free(wadinfo.arena);
+    free_index(wadinfo.index);
+    free(wadinfo.directory);
+    free(outputs);
     free_args(&myarglist);
-    fclose(wadfile);
-    return 0;
+    fclose(wadinfo.wadfile);
+    free(pk3_buffer);
+    if (old_wad.wadfile) {
+        arena_free(old_wad.arena);
+        free_index(old_wad.index);
+        free(old_wad.directory);
+        fclose(old_wad.wadfile);
+        free(old_pk3_buffer);
+    }
+    return ok ? 0 : 1;
 }
@@ -3,19 +3,243 @@
 #include <stdlib.h>
 #include "map2img.h"
 
-#define MONSTER_SIZE 16
-#define WEAPON_SIZE  12
-#define KEY_SIZE     12
-#define AMMO_SIZE     8
-#define ITEM_SIZE     8
-#define LINEDEF_WIDTH 4
-#define LINEDEF_SLIM  2
 #define WIDTH  imginfo->width * imginfo->scale + (2 * imginfo->padding)
 #define HEIGHT imginfo->height * imginfo->scale + (2 * imginfo->padding)
 #define REAL_X(x) imginfo->padding + (x + imginfo->x_off)*imginfo->scale
 #define REAL_Y(y) imginfo->padding + (imginfo->max_y - y)*imginfo->scale
 
-void draw_direction(FILE* output, Thing t, double x, double y, float scale, const char* color) {
+const Linestyle linestyles[NUM_LINE_CLASSES] = {
+    [LINE_NORMAL]      = { "normal",      "n",  "white",       0xffffff },
+    [LINE_BLUE_DOOR]   = { "blue_door",   "b",  "blue",        0x0000ff },
+    [LINE_YELLOW_DOOR] = { "yellow_door", "y",  "yellow",      0xffff00 },
+    [LINE_RED_DOOR]    = { "red_door",    "r",  "red",         0xff0000 },
+    [LINE_DOOR]        = { "door",        "d",  "gainsboro",   0xdcdcdc },
+    [LINE_STAIRS]      = { "stairs",      "st", "orange",      0xffa500 },
+    [LINE_EXIT]        = { "exit",        "e",  "springgreen", 0x00ff7f },
+    [LINE_TELEPORT]    = { "teleport",    "t",  "purple",      0x800080 },
+    [LINE_LIFT]        = { "lift",        "l",  "saddlebrown", 0x8b4513 },
+    [LINE_FLOOR]       = { "floor",       "f",  "slategrey",   0x708090 },
+    [LINE_OTHER]       = { "other",       "o",  "magenta",     0xff00ff },
+};
+
+const Thingstyle thingstyles[NUM_THING_CLASSES] = {
+    [THING_MONSTER]    = { "monster",    "m",  "crimson",        0xdc143c, MONSTER_SIZE, true },
+    [THING_WEAPON]     = { "weapon",     "w",  "lightsteelblue", 0xb0c4de, WEAPON_SIZE,  false },
+    [THING_AMMO]       = { "ammo",       "a",  "lightsteelblue", 0xb0c4de, AMMO_SIZE,    false },
+    [THING_ITEM]       = { "item",       "i",  "lavender",       0xe6e6fa, ITEM_SIZE,    false },
+    [THING_BLUE_KEY]   = { "blue_key",   "kb", "blue",           0x0000ff, KEY_SIZE,     false },
+    [THING_RED_KEY]    = { "red_key",    "kr", "red",            0xff0000, KEY_SIZE,     false },
+    [THING_YELLOW_KEY] = { "yellow_key", "ky", "yellow",         0xffff00, KEY_SIZE,     false },
+    [THING_PLAYER]     = { "player",     "p",  "green",          0x008000, MONSTER_SIZE, true },
+    [THING_OTHER]      = { "other",      "u",  "magenta",        0xff00ff, ITEM_SIZE,    false },
+};
+
+Lineclass classify_linedef(int16_t special) {
+    switch(special) {
+        case 0:
+            return LINE_NORMAL;
+        case 26:
+        case 32:
+            // Blue door
+            return LINE_BLUE_DOOR;
+        case 27:
+        case 34:
+            // Yellow door
+            return LINE_YELLOW_DOOR;
+        case 28:
+        case 33:
+            // Red door
+            return LINE_RED_DOOR;
+        case 1:
+        case 2:
+        case 3:
+        case 4:
+        case 29:
+        case 31:
+        case 42:
+        case 46:
+        case 50:
+        case 61:
+        case 63:
+        case 75:
+        case 76:
+        case 86:
+        case 90:
+        case 99:
+        case 103:
+        case 105:
+        case 106:
+        case 107:
+        case 108:
+        case 109:
+        case 110:
+        case 111:
+        case 112:
+        case 113:
+        case 114:
+        case 115:
+        case 116:
+        case 117:
+        case 118:
+            // Door
+            return LINE_DOOR;
+        case 7:
+        case 8:
+            // Stairs
+            return LINE_STAIRS;
+        case 11:
+        case 51:
+        case 52:
+        case 124:
+            // Exit
+            return LINE_EXIT;
+        case 39:
+        case 97:
+            // Teleport
+            return LINE_TELEPORT;
+        case 62:
+        case 88:
+        case 120:
+        case 121:
+        case 122:
+        case 123:
+            // Lift
+            return LINE_LIFT;
+        case 5:
+        case 9:
+        case 14:
+        case 15:
+        case 18:
+        case 19:
+        case 20:
+        case 22:
+        case 23:
+        case 24:
+        case 30:
+        case 36:
+        case 37:
+        case 38:
+        case 45:
+        case 47:
+        case 55:
+        case 56:
+        case 58:
+        case 59:
+        case 60:
+        case 64:
+        case 65:
+        case 66:
+        case 67:
+        case 68:
+        case 69:
+        case 70:
+        case 71:
+            // Floor
+            return LINE_FLOOR;
+        default:
+            return LINE_OTHER;
+    }
+}
+
+Thingclass classify_thing(int16_t type) {
+    switch(type) {
+        case 68:
+        case 64:
+        case 3003:
+        case 3005:
+        case 72:
+        case 16:
+        case 3002:
+        case 65:
+        case 69:
+        case 3001:
+        case 3006:
+        case 67:
+        case 71:
+        case 66:
+        case 9:
+        case 58:
+        case 7:
+        case 84:
+        case 3004:
+            // Monster
+            return THING_MONSTER;
+        case 2001:
+        case 2002:
+        case 2003:
+        case 2004:
+        case 2005:
+        case 2006:
+        case 82:
+            // Weapon
+            return THING_WEAPON;
+        case 2008:
+        case 2010:
+        case 2048:
+        case 2046:
+        case 2049:
+        case 2007:
+        case 2047:
+        case 17:
+            // Ammo
+            return THING_AMMO;
+        case 2013:
+        case 2014:
+        case 2015:
+        case 2023:
+        case 2026:
+        case 2022:
+        case 2045:
+        case 83:
+        case 2024:
+        case 2018:
+        case 8:
+        case 2012:
+        case 2019:
+        case 2025:
+        case 2011:
+            // Artifact items and powerups
+            return THING_ITEM;
+        case 5:
+        case 40:
+            // Blue keys
+            return THING_BLUE_KEY;
+        case 13:
+        case 38:
+            // Red keys
+            return THING_RED_KEY;
+        case 6:
+        case 39:
+            // Yellow keys
+            return THING_YELLOW_KEY;
+        case 1:
+        case 2:
+        case 3:
+        case 4:
+        case 11:
+            // Player/Deathmatch start
+            return THING_PLAYER;
+        default:
+            return THING_OTHER;
+    }
+}
+
+// classifies every linedef and thing once, so several outputs of the same
+// map don't repeat the work. false: out of memory.
+bool classify_map(Wadinfo* wadinfo) {
+    wadinfo->line_classes  = arena_alloc(wadinfo->arena, wadinfo->num_linedefs + 1);
+    wadinfo->thing_classes = arena_alloc(wadinfo->arena, wadinfo->num_things + 1);
+    if (wadinfo->line_classes == NULL || wadinfo->thing_classes == NULL) return false;
+    for (long int i=0; i<wadinfo->num_linedefs; ++i) {
+        wadinfo->line_classes[i] = classify_linedef(wadinfo->linedefs[i].special);
+    }
+    for (long int i=0; i<wadinfo->num_things; ++i) {
+        wadinfo->thing_classes[i] = classify_thing(wadinfo->things[i].type);
+    }
+    return true;
+}
+
+void direction_end(Thing t, double x, double y, float scale, double* x_end, double* y_end) {
     double x2 = x;
     double y2 = y;
     double len = (MONSTER_SIZE + 4) * scale;
@@ -52,272 +276,253 @@ void draw_direction(FILE* output, Thing t, double x, double y, float scale, cons
         default:
             break;
     }
+    *x_end = x2;
+    *y_end = y2;
+}
+
+void draw_direction(FILE* output, Thing t, double x, double y, float scale, const char* color) {
+    double x2, y2;
+    direction_end(t, x, y, scale, &x2, &y2);
     fprintf(output, "<line x1=\"%g\" y1=\"%g\" x2=\"%g\" y2=\"%g\" stroke=\"%s", x, y, x2, y2, color);
 }
 
+// in raw mode all sizes are given in map units, the group transform
+// does the scaling:
+#define UNIT (imginfo->raw ? 1.0 : imginfo->scale)
+
+// prints a coordinate attribute pair, either transformed into image space
+// or (raw mode) as the original integer map coordinates
+void print_point(FILE* output, Imginfo* imginfo, const char* x_name, const char* y_name, int x, int y) {
+    if (imginfo->raw) {
+        fprintf(output, " %s=\"%d\" %s=\"%d\"", x_name, x, y_name, y);
+    }
+    else {
+        fprintf(output, " %s=\"%g\" %s=\"%g\"", x_name, REAL_X(x), y_name, REAL_Y(y));
+    }
+}
+
+// compact mode: all styling goes into one <style> block and one <symbol>
+// per thing class, elements only carry a class or a <use> reference
+void output_svg_styles(Imginfo* imginfo, FILE* output) {
+    fprintf(output, "<style>");
+    fprintf(output, "line{stroke-width:%g}", LINEDEF_WIDTH * UNIT);
+    fprintf(output, ".s{stroke-width:%g}", LINEDEF_SLIM * UNIT);
+    for (int i=0; i<imginfo->num_linestyles; ++i) {
+        fprintf(output, ".%s{stroke:%s}", imginfo->linestyles[i].css, imginfo->linestyles[i].color);
+    }
+    fprintf(output, ".v{stroke:yellow;stroke-width:1%s}", imginfo->raw ? ";vector-effect:non-scaling-stroke" : "");
+    fprintf(output, "</style>\n");
+    if (imginfo->draw_things) {
+        fprintf(output, "<defs>");
+        for (int i=0; i<imginfo->num_thingstyles; ++i) {
+            const Thingstyle* style = &imginfo->thingstyles[i];
+            fprintf(output, "<symbol id=\"%s\" overflow=\"visible\"><circle r=\"%g\" fill=\"%s\"/></symbol>", style->css, style->size * UNIT, style->color);
+        }
+        fprintf(output, "</defs>\n");
+    }
+}
+
+void output_linedef(Imginfo* imginfo, Wadinfo* wadinfo, FILE* output, bool verbose, int i) {
+    Linedef* linedef = &wadinfo->linedefs[i];
+    Vertex start = wadinfo->vertexes[(unsigned short)linedef->v_start];
+    Vertex end   = wadinfo->vertexes[(unsigned short)linedef->v_end];
+    const Linestyle* style = &imginfo->linestyles[wadinfo->line_classes[i]];
+
+    if (verbose) {
+        fprintf(output, "<!-- Linedef %d - Flags: %d / Special: %d -->\n", i, linedef->flags, linedef->special);
+    }
+
+    if (imginfo->compact) {
+        fprintf(output, "<line class=\"%s%s\"", style->css, linedef->flags == 4 ? " s" : "");
+        print_point(output, imginfo, "x1", "y1", start.x, start.y);
+        print_point(output, imginfo, "x2", "y2", end.x, end.y);
+        fprintf(output, "/>\n");
+        return;
+    }
+
+    fprintf(output, "<line");
+    print_point(output, imginfo, "x1", "y1", start.x, start.y);
+    print_point(output, imginfo, "x2", "y2", end.x, end.y);
+    fprintf(output, " stroke=\"%s\" stroke-width=\"", style->color);
+    switch(linedef->flags) {
+        case 4:
+            fprintf(output, "%g", LINEDEF_SLIM * UNIT);
+            break;
+        default:
+            fprintf(output, "%g", LINEDEF_WIDTH * UNIT);
+            break;
+    }
+    fprintf(output, "\"/>\n");
+}
+
+void output_thing(Imginfo* imginfo, Wadinfo* wadinfo, FILE* output, bool verbose, int i) {
+    Thing* thing = &wadinfo->things[i];
+    const Thingstyle* style = &imginfo->thingstyles[wadinfo->thing_classes[i]];
+    if (verbose) {
+        fprintf(output, "<!-- Thing type: %d / angle: %d / flags: %d -->\n", thing->type, thing->angle, thing->flags);
+    }
+
+    if (imginfo->raw) {
+        if (imginfo->compact) {
+            fprintf(output, "<use xlink:href=\"#%s\"", style->css);
+            print_point(output, imginfo, "x", "y", thing->x_pos, thing->y_pos);
+            fprintf(output, "/>\n");
+        }
+        else {
+            fprintf(output, "<circle");
+            print_point(output, imginfo, "cx", "cy", thing->x_pos, thing->y_pos);
+            fprintf(output, " fill=\"%s\" r=\"%d\" />\n", style->color, style->size);
+        }
+        if (style->direction) {
+            // direction_end() works in image space (y pointing down):
+            double x2, y2;
+            direction_end(*thing, thing->x_pos, thing->y_pos, 1.0, &x2, &y2);
+            y2 = 2 * thing->y_pos - y2;
+            if (imginfo->compact) {
+                fprintf(output, "<line class=\"v\"");
+            }
+            else {
+                fprintf(output, "<line stroke=\"yellow\" vector-effect=\"non-scaling-stroke\"");
+            }
+            fprintf(output, " x1=\"%d\" y1=\"%d\" x2=\"%g\" y2=\"%g\"/>\n", thing->x_pos, thing->y_pos, x2, y2);
+        }
+        return;
+    }
+
+    double x = REAL_X(thing->x_pos);
+    double y = REAL_Y(thing->y_pos);
+    if (imginfo->compact) {
+        fprintf(output, "<use xlink:href=\"#%s\" x=\"%g\" y=\"%g\"/>\n", style->css, x, y);
+        if (style->direction) {
+            double x2, y2;
+            direction_end(*thing, (float)x, (float)y, imginfo->scale, &x2, &y2);
+            fprintf(output, "<line class=\"v\" x1=\"%g\" y1=\"%g\" x2=\"%g\" y2=\"%g\"/>\n", (float)x, (float)y, x2, y2);
+        }
+        return;
+    }
+    fprintf(output, "<circle cx=\"%g\" cy=\"%g\" ", x, y);
+    fprintf(output, "fill=\"%s\" r=\"%g", style->color, style->size * imginfo->scale);
+    if (style->direction) {
+        fprintf(output, "\" />\n");
+        draw_direction(output, *thing, (float)x, (float)y, imginfo->scale, "yellow");
+    }
+    fprintf(output, "\" />\n");
+}
+
+// elements per job when formatting in parallel
+#define EMIT_CHUNK 4096
+
+typedef struct {
+    Imginfo* imginfo;
+    Wadinfo* wadinfo;
+    bool verbose;
+    bool things;
+    long int count;
+    char** buffers;  // svg text of every chunk, in element order
+    size_t* sizes;
+} Emitjob;
+
+// formats the linedefs or things [start, end) in emission order
+static void emit_range(Imginfo* imginfo, Wadinfo* wadinfo, FILE* output, bool verbose, bool things, long int start, long int end) {
+    int* order = things ? wadinfo->thing_order : wadinfo->line_order;
+    for (long int i=start; i<end; ++i) {
+        int index = order ? order[i] : i;
+        if (things) {
+            output_thing(imginfo, wadinfo, output, verbose, index);
+        }
+        else {
+            output_linedef(imginfo, wadinfo, output, verbose, index);
+        }
+    }
+}
+
+static void emit_chunk(int index, int thread, void* ctx) {
+    Emitjob* job = ctx;
+    long int start = (long int)index * EMIT_CHUNK;
+    long int end   = start + EMIT_CHUNK < job->count ? start + EMIT_CHUNK : job->count;
+    FILE* buffer = open_memstream(&job->buffers[index], &job->sizes[index]);
+    emit_range(job->imginfo, job->wadinfo, buffer, job->verbose, job->things, start, end);
+    fclose(buffer);
+}
+
+// every element is formatted independently, so big maps are split into
+// chunks that the pool formats into their own buffers. Writing the buffers
+// in chunk order gives exactly the single threaded output.
+static void emit_elements(Imginfo* imginfo, Wadinfo* wadinfo, FILE* output, bool verbose, bool things) {
+    long int count = things ? wadinfo->num_things : wadinfo->num_linedefs;
+    int num_chunks = (count + EMIT_CHUNK - 1) / EMIT_CHUNK;
+    if (imginfo->threads <= 1 || num_chunks <= 1) {
+        emit_range(imginfo, wadinfo, output, verbose, things, 0, count);
+        return;
+    }
+    Emitjob job = { imginfo, wadinfo, verbose, things, count };
+    job.buffers = calloc(num_chunks, sizeof(char*));
+    job.sizes   = calloc(num_chunks, sizeof(size_t));
+    run_pool(num_chunks, imginfo->threads, emit_chunk, &job);
+    for (int i=0; i<num_chunks; ++i) {
+        fwrite(job.buffers[i], 1, job.sizes[i], output);
+        free(job.buffers[i]);
+    }
+    free(job.buffers);
+    free(job.sizes);
+}
+
+unsigned int output_svg_needs(Imginfo* imginfo) {
+    unsigned int needs = NEED(LUMP_LINEDEFS) | NEED(LUMP_VERTEXES);
+    if (imginfo->draw_things) needs |= NEED(LUMP_THINGS);
+    return needs;
+}
+
 void output_svg(Imginfo* imginfo, Wadinfo* wadinfo, FILE* output, bool verbose, Header* wadheader) {
-    int num_linedefs = wadinfo->num_linedefs;
-    int num_things   = wadinfo->num_things;
-    Linedef* linedefs = wadinfo->linedefs;
-    Vertex*  vertexes = wadinfo->vertexes;
-    Thing*   things   = wadinfo->things;
     fprintf(output, "<?xml version=\"1.0\" encoding=\"UTF-8\" standalone=\"no\"?>");
     fprintf(output, "<svg version=\"1.1\"");
     fprintf(output, "  xmlns=\"http://www.w3.org/2000/svg\"\n");
     fprintf(output, "  xmlns:svg=\"http://www.w3.org/2000/svg\"\n");
-    fprintf(output, "  width=\"%g\" height=\"%g\">\n\n", WIDTH, HEIGHT);
+    if (imginfo->compact) {
+        // <use> needs xlink:href in SVG 1.1
+        fprintf(output, "  xmlns:xlink=\"http://www.w3.org/1999/xlink\"\n");
+    }
+    // raw mode: the viewBox is in map units, only width and height depend on
+    // the scale factor
+    double padding = imginfo->padding / imginfo->scale;
+    double view_width  = imginfo->width  + 2 * padding;
+    double view_height = imginfo->height + 2 * padding;
+    if (imginfo->raw) {
+        fprintf(output, "  width=\"%g\" height=\"%g\" viewBox=\"0 0 %g %g\">\n\n", WIDTH, HEIGHT, view_width, view_height);
+    }
+    else {
+        fprintf(output, "  width=\"%g\" height=\"%g\">\n\n", WIDTH, HEIGHT);
+    }
     if (verbose) {
         fprintf(output, "<!--\n");
         fprintf(output, "wadfile         : %s => %s\n", wadinfo->filename, wadinfo->wad_ident);
         fprintf(output, "map             : %s\n", wadinfo->mapname);
         fprintf(output, "num_lumps       : %d\n", wadheader->num_lumps);
-        fprintf(output, "num_things      : %ld\n", wadinfo->num_things);
+        // the things lump is only read when they are drawn:
+        long int num_things = wadinfo->things ? wadinfo->num_things : wadinfo->lumpdir[LUMP_THINGS].size / (long int)sizeof(Thing);
+        fprintf(output, "num_things      : %ld\n", num_things);
         fprintf(output, "Linedefs        : %ld\n", wadinfo->num_linedefs);
         fprintf(output, "Vertexes        : %ld\n", wadinfo->num_vertexes);
         fprintf(output, "scaling         : %g\n", imginfo->scale);
         fprintf(output, "-->\n");
     }
-    fprintf(output, "<rect width=\"%g\" height=\"%g\" fill=\"black\" />\n", WIDTH, HEIGHT);
-    for (int i=0; i<num_linedefs; ++i) {
-        int16_t v_index_start = linedefs[i].v_start;
-        int16_t v_index_end   = linedefs[i].v_end;
-        Vertex start = vertexes[v_index_start];
-        Vertex end   = vertexes[v_index_end];
-
-        if (verbose) {
-            fprintf(output, "<!-- Linedef %d - Flags: %d / Special: %d -->\n", i, linedefs[i].flags, linedefs[i].special);
-        }
-
-        fprintf(output, "<line x1=\"%g\" y1=\"%g\"", REAL_X(start.x), REAL_Y(start.y));
-        fprintf(output, " x2=\"%g\" y2=\"%g\"", REAL_X(end.x), REAL_Y(end.y));
-        fprintf(output, " stroke=\"");
-        switch(linedefs[i].special) {
-            case 0:
-                fprintf(output, "white");
-                break;
-            case 26:
-            case 32:
-                // Blue door
-                fprintf(output, "blue");
-                break;
-            case 27:
-            case 34:
-                // Yellow door
-                fprintf(output, "yellow");
-                break;
-            case 28:
-            case 33:
-                // Red door
-                fprintf(output, "red");
-                break;
-            case 1:
-            case 2:
-            case 3:
-            case 4:
-            case 29:
-            case 31:
-            case 42:
-            case 46:
-            case 50:
-            case 61:
-            case 63:
-            case 75:
-            case 76:
-            case 86:
-            case 90:
-            case 99:
-            case 103:
-            case 105:
-            case 106:
-            case 107:
-            case 108:
-            case 109:
-            case 110:
-            case 111:
-            case 112:
-            case 113:
-            case 114:
-            case 115:
-            case 116:
-            case 117:
-            case 118:
-                // Door
-                fprintf(output, "gainsboro");
-                break;
-            case 7:
-            case 8:
-                // Stairs
-                fprintf(output, "orange");
-                break;
-            case 11:
-            case 51:
-            case 52:
-            case 124:
-                // Exit
-                fprintf(output, "springgreen");
-                break;
-            case 39:
-            case 97:
-                // Teleport
-                fprintf(output, "purple");
-                break;
-            case 62:
-            case 88:
-            case 120:
-            case 121:
-            case 122:
-            case 123:
-                // Lift
-                fprintf(output, "saddlebrown");
-                break;
-            case 5:
-            case 9:
-            case 14:
-            case 15:
-            case 18:
-            case 19:
-            case 20:
-            case 22:
-            case 23:
-            case 24:
-            case 30:
-            case 36:
-            case 37:
-            case 38:
-            case 45:
-            case 47:
-            case 55:
-            case 56:
-            case 58:
-            case 59:
-            case 60:
-            case 64:
-            case 65:
-            case 66:
-            case 67:
-            case 68:
-            case 69:
-            case 70:
-            case 71:
-                // Floor
-                fprintf(output, "slategrey");
-                break;
-            default:
-                fprintf(output, "magenta");
-                break;
-        }
-        fprintf(output, "\" stroke-width=\"");
-        switch(linedefs[i].flags) {
-            case 4:
-                fprintf(output, "%g", LINEDEF_SLIM * imginfo->scale);
-                break;
-            default:
-                fprintf(output, "%g", LINEDEF_WIDTH * imginfo->scale);
-                break;
-        }
-        fprintf(output, "\"/>\n");
+    if (imginfo->compact) {
+        output_svg_styles(imginfo, output);
+    }
+    if (imginfo->raw) {
+        fprintf(output, "<rect width=\"%g\" height=\"%g\" fill=\"black\" />\n", view_width, view_height);
+        fprintf(output, "<g transform=\"translate(%g %g) scale(1 -1)\">\n", padding + imginfo->x_off, padding + imginfo->max_y);
     }
+    else {
+        fprintf(output, "<rect width=\"%g\" height=\"%g\" fill=\"black\" />\n", WIDTH, HEIGHT);
+    }
+    emit_elements(imginfo, wadinfo, output, verbose, false);
     if (imginfo->draw_things) {
         fprintf(output, "<!-- Things: -->\n");
-        for (int i=0; i<num_things; ++i) {
-            if (verbose) {
-                fprintf(output, "<!-- Thing type: %d / angle: %d / flags: %d -->\n", things[i].type, things[i].angle, things[i].flags);
-            }
-            fprintf(output, "<circle cx=\"%g\" cy=\"%g\" ", REAL_X(things[i].x_pos), REAL_Y(things[i].y_pos));
-            fprintf(output, "fill=\"");
-            switch(things[i].type) {
-                case 68:
-                case 64:
-                case 3003:
-                case 3005:
-                case 72:
-                case 16:
-                case 3002:
-                case 65:
-                case 69:
-                case 3001:
-                case 3006:
-                case 67:
-                case 71:
-                case 66:
-                case 9:
-                case 58:
-                case 7:
-                case 84:
-                case 3004:
-                    // Monster
-                    fprintf(output, "crimson\" r=\"%g\" />\n", MONSTER_SIZE * imginfo->scale);
-                    draw_direction(output, things[i], (float)REAL_X(things[i].x_pos), (float)REAL_Y(things[i].y_pos), imginfo->scale, "yellow");
-                    break;
-                case 2001:
-                case 2002:
-                case 2003:
-                case 2004:
-                case 2005:
-                case 2006:
-                case 82:
-                    // Weapon
-                    fprintf(output, "lightsteelblue\" r=\"%g", WEAPON_SIZE * imginfo->scale);
-                    break;
-                case 2008:
-                case 2010:
-                case 2048:
-                case 2046:
-                case 2049:
-                case 2007:
-                case 2047:
-                case 17:
-                    // Ammo
-                    fprintf(output, "lightsteelblue\" r=\"%g", AMMO_SIZE * imginfo->scale);
-                    break;
-                case 2013:
-                case 2014:
-                case 2015:
-                case 2023:
-                case 2026:
-                case 2022:
-                case 2045:
-                case 83:
-                case 2024:
-                case 2018:
-                case 8:
-                case 2012:
-                case 2019:
-                case 2025:
-                case 2011:
-                    // Artifact items and powerups
-                    fprintf(output, "lavender\" r=\"%g", ITEM_SIZE * imginfo->scale);
-                    break;
-                case 5:
-                case 40:
-                    // Blue keys
-                    fprintf(output, "blue\" r=\"%g", KEY_SIZE * imginfo->scale);
-                    break;
-                case 13:
-                case 38:
-                    // Red keys
-                    fprintf(output, "red\" r=\"%g", KEY_SIZE * imginfo->scale);
-                    break;
-                case 6:
-                case 39:
-                    // Yellow keys
-                    fprintf(output, "yellow\" r=\"%g", KEY_SIZE * imginfo->scale);
-                    break;
-                case 1:
-                case 2:
-                case 3:
-                case 4:
-                case 11:
-                    // Player/Deathmatch start
-                    fprintf(output, "green\" r=\"%g\" />\n", MONSTER_SIZE * imginfo->scale);
-                    draw_direction(output, things[i], (float)REAL_X(things[i].x_pos), (float)REAL_Y(things[i].y_pos), imginfo->scale, "yellow");
-                    break;
-                default: 
-                    fprintf(output, "magenta\" r=\"%g", ITEM_SIZE * imginfo->scale);
-                    break;
-            }
-            fprintf(output, "\" />\n");
-        }
+        emit_elements(imginfo, wadinfo, output, verbose, true);
+    }
+    if (imginfo->raw) {
+        fprintf(output, "</g>\n");
     }
     fprintf(output, "</svg>\n");
 }
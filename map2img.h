@@ -28,18 +28,28 @@ typedef struct {
     int16_t flags;
 } Thing;
 
+// https://doomwiki.org/wiki/Sidedef
+typedef struct {
+    int16_t x_offset;
+    int16_t y_offset;
+    char upper_texture[8];
+    char lower_texture[8];
+    char middle_texture[8];
+    int16_t sector;
+} Sidedef;
+
 // https://doomwiki.org/wiki/Sector
-// TODO: sectors do not contain the linedefs, but linedefs contain
-// information which sector they belong to.
-//typedef struct {
-//    int16_t floor_heigth;
-//    int16_t ceiling_height;
-//    char[8] floor_texture;
-//    char[8] ceiling_texture;
-//    int16_t light_level;
-//    int16_t special_type;
-//    int16_t tag_number;
-//} Sector;
+// sectors do not contain the linedefs, but linedefs contain (through
+// their sidedefs) information which sector they belong to.
+typedef struct {
+    int16_t floor_height;
+    int16_t ceiling_height;
+    char floor_texture[8];
+    char ceiling_texture[8];
+    int16_t light_level;
+    int16_t special_type;
+    int16_t tag_number;
+} Sector;
 
 // https://doomwiki.org/wiki/WAD
 typedef struct {
@@ -54,6 +64,33 @@ typedef struct {
     char name[8];
 } Direntry;
 
+// the lumps that make up a map, in WAD order
+typedef enum {
+    LUMP_THINGS,
+    LUMP_LINEDEFS,
+    LUMP_SIDEDEFS,
+    LUMP_VERTEXES,
+    LUMP_SEGS,
+    LUMP_SSECTORS,
+    LUMP_NODES,
+    LUMP_SECTORS,
+    LUMP_REJECT,
+    LUMP_BLOCKMAP,
+    LUMP_BEHAVIOR,
+    NUM_MAP_LUMPS
+} Maplump;
+
+#define NEED(lump) (1u << (lump))
+
+// flats and palette of a WAD, shared by all its maps (raster.c)
+typedef struct Flatcache Flatcache;
+
+// sidecar index of a WAD (index.c)
+typedef struct Wadindex Wadindex;
+
+// bump allocator for everything that lives as long as one map (arena.c)
+typedef struct Arena Arena;
+
 typedef struct {
     char* filename;
     char* mapname;
@@ -62,12 +99,108 @@ typedef struct {
     Linedef* linedefs;
     Vertex* vertexes;
     Thing* things;
+    Sidedef* sidedefs;
+    Sector* sectors;
     long int num_linedefs;
     long int num_vertexes;
     long int num_things;
+    long int num_sidedefs;
+    long int num_sectors;
+    unsigned char* line_classes;  // Lineclass per linedef, see classify_map()
+    unsigned char* thing_classes; // Thingclass per thing
+    int* line_order;              // svg emission order, NULL: lump order (hilbert.c)
+    int* thing_order;
+    Direntry lumpdir[NUM_MAP_LUMPS]; // size -1: lump not in the map
+    void* lumps[NUM_MAP_LUMPS];      // NULL until read by get_lump()
+    Arena* arena;                    // lumps and everything derived from them, reset by free_lumps()
+    Direntry* directory;             // whole lump directory, see read_directory()
+    Flatcache* flats;                // NULL until a raster output needs it
+    Wadindex* index;                 // NULL without -i
+    int map_index;                   // index record of the current map, -1: none
+    bool pk3_map;                    // maps/<mapname>.wad from a pk3, its marker lump can have any name
     FILE* wadfile;
 } Wadinfo;
 
+typedef enum {
+    FORMAT_SVG,
+    FORMAT_HTML,
+    FORMAT_PNG
+} Format;
+
+// one image to write (-s and -o can be lists), the format follows from
+// the file name extension
+typedef struct {
+    char* filename;
+    float scale;
+    Format format;
+} Output;
+
+// sizes in map units (multiplied by the scale factor for svg)
+#define MONSTER_SIZE 16
+#define WEAPON_SIZE  12
+#define KEY_SIZE     12
+#define AMMO_SIZE     8
+#define ITEM_SIZE     8
+#define LINEDEF_WIDTH 4
+#define LINEDEF_SLIM  2
+
+// classification of linedefs (by special) and things (by type), see
+// classify_linedef() and classify_thing() in makesvg.c
+typedef enum {
+    LINE_NORMAL,
+    LINE_BLUE_DOOR,
+    LINE_YELLOW_DOOR,
+    LINE_RED_DOOR,
+    LINE_DOOR,
+    LINE_STAIRS,
+    LINE_EXIT,
+    LINE_TELEPORT,
+    LINE_LIFT,
+    LINE_FLOOR,
+    LINE_OTHER,
+    NUM_LINE_CLASSES
+} Lineclass;
+
+typedef enum {
+    THING_MONSTER,
+    THING_WEAPON,
+    THING_AMMO,
+    THING_ITEM,
+    THING_BLUE_KEY,
+    THING_RED_KEY,
+    THING_YELLOW_KEY,
+    THING_PLAYER,
+    THING_OTHER,
+    NUM_THING_CLASSES
+} Thingclass;
+
+// diff mode (diff.c) replaces the classes with the change of each element
+typedef enum {
+    DIFF_UNCHANGED,
+    DIFF_ADDED,
+    DIFF_REMOVED,
+    DIFF_MODIFIED,
+    NUM_DIFF_CLASSES
+} Diffclass;
+
+// name = used in JSON output, css = short class/symbol id in compact svg,
+// rgb = color as 0xRRGGBB for raster output
+typedef struct {
+    const char* name;
+    const char* css;
+    const char* color;
+    unsigned int rgb;
+} Linestyle;
+
+typedef struct {
+    const char* name;
+    const char* css;
+    const char* color;
+    unsigned int rgb;
+    int size;
+    bool direction;
+} Thingstyle;
+
 typedef struct {
     int x_off;
     int y_off;
@@ -76,8 +209,17 @@ typedef struct {
     int width;
     int height;
     bool draw_things;
+    bool compact;
+    bool raw;
     float scale;
     int padding;
+    bool hilbert;   // svg elements in Hilbert curve order, see order_map()
+    int threads;    // svg elements are formatted in parallel (-j)
+    // svg style tables, indexed by wadinfo->line_classes/thing_classes
+    const Linestyle* linestyles;
+    const Thingstyle* thingstyles;
+    int num_linestyles;
+    int num_thingstyles;
 } Imginfo;
 
 // https://doomwiki.org/wiki/WAD#Lump_order
@@ -99,4 +241,87 @@ typedef struct {
 // so first we find the name of the map (E1M1),
 // then the next LINEDEFS and VERTEXES entries
 
+// pool.c:
+typedef void (*pool_job)(int index, int thread, void* ctx);
+int pool_default_threads(void);
+void run_pool(int num_jobs, int num_threads, pool_job job, void* ctx);
+
+// main.c:
+bool is_wad_ident(const char* identification);
+bool is_map_name(const char* name);
+bool read_directory(Wadinfo* wadinfo);
+bool find_map(Wadinfo* wadinfo);
+void generate_minmax(int* max_x, int* min_x, int* max_y, int* min_y, Vertex* vertexes, int num_vertexes);
+
+// arena.c:
+Arena* arena_create(size_t block_size);
+void* arena_alloc(Arena* arena, size_t size);
+void* arena_calloc(Arena* arena, size_t count, size_t size);
+void arena_reset(Arena* arena);
+void arena_free(Arena* arena);
+
+// lumps.c:
+extern const char* map_lump_names[NUM_MAP_LUMPS];
+int map_lump_index(const char* name);
+void* read_lump(FILE* wadfile, Direntry* direntry, Arena* arena);
+void init_lumps(Wadinfo* wadinfo);
+void* get_lump(Wadinfo* wadinfo, Maplump lump);
+bool load_lumps(Wadinfo* wadinfo, unsigned int needs);
+void free_lumps(Wadinfo* wadinfo);
+
+// makesvg.c:
+extern const Linestyle linestyles[NUM_LINE_CLASSES];
+extern const Thingstyle thingstyles[NUM_THING_CLASSES];
+Lineclass classify_linedef(int16_t special);
+Thingclass classify_thing(int16_t type);
+bool classify_map(Wadinfo* wadinfo);
+unsigned int output_svg_needs(Imginfo* imginfo);
+void output_svg(Imginfo* imginfo, Wadinfo* wadinfo, FILE* output, bool verbose, Header* wadheader);
+
+// diff.c:
+extern const Linestyle diff_linestyles[NUM_DIFF_CLASSES];
+extern const Thingstyle diff_thingstyles[NUM_DIFF_CLASSES];
+bool diff_maps(Wadinfo* old_map, Wadinfo* new_map, Wadinfo* diff, bool verbose);
+
+// hilbert.c:
+bool order_map(Wadinfo* wadinfo);
+
+// index.c:
+bool open_index(Wadinfo* wadinfo, bool verbose);
+Direntry* index_directory(Wadindex* index);
+int index_find_lump(Wadindex* index, const char* name);
+bool index_find_map(Wadinfo* wadinfo);
+bool index_bounds(Wadinfo* wadinfo, int* max_x, int* min_x, int* max_y, int* min_y);
+void index_list_maps(Wadinfo* wadinfo);
+void free_index(Wadindex* index);
+
+// html.c:
+unsigned int output_html_needs(Imginfo* imginfo);
+void output_html(Imginfo* imginfo, Wadinfo* wadinfo, FILE* output);
+
+// raster.c:
+unsigned int output_png_needs(Imginfo* imginfo);
+bool output_png(Imginfo* imginfo, Wadinfo* wadinfo, FILE* output);
+bool write_rgb_png(const unsigned int* pixels, int width, int height, FILE* output);
+void free_flatcache(Flatcache* flats);
+
+// pk3.c:
+unsigned int crc32_update(unsigned int crc, const unsigned char* data, size_t len);
+bool is_pk3(const Header* header);
+bool list_pk3_maps(FILE* pk3, const char* filename);
+FILE* open_pk3_map(FILE* pk3, const char* filename, const char* mapname, unsigned char** buffer);
+
+// stats.c:
+unsigned int stats_needs(void);
+bool output_wad_stats(Wadinfo* wadinfo, FILE* output);
+
+// catalog.c:
+void print_json_string(FILE* output, const char* s, size_t maxlen);
+bool catalog_wads(const char* dirname, FILE* output, int num_threads, bool verbose);
+int list_files(const char* dirname, char*** paths);
+void free_files(char** paths, int count);
+
+// heatmap.c:
+bool heatmap_wads(const char* dirname, const char* prefix, int num_threads, bool verbose);
+
 #endif // MAP2IMG_H_
@@ -0,0 +1,500 @@
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+#include "map2img.h"
+
+// PK3 (zip) input: maps are stored as WAD files under maps/ in the
+// archive. The entry is found through the zip central directory and
+// inflated into memory, the buffer is then opened with fmemopen() so the
+// usual WAD code (find_map() etc.) reads it like a file on disk.
+// https://pkware.cachefly.net/webdocs/casestudies/APPNOTE.TXT
+// https://www.rfc-editor.org/rfc/rfc1951 (deflate)
+
+#define ZIP_LOCAL_SIG   0x04034b50
+#define ZIP_CENTRAL_SIG 0x02014b50
+#define ZIP_END_SIG     0x06054b50
+#define ZIP_LOCAL_SIZE    30
+#define ZIP_CENTRAL_SIZE  46
+#define ZIP_END_SIZE      22
+#define ZIP_MAX_COMMENT   65535
+
+#define ZIP_STORED  0
+#define ZIP_DEFLATE 8
+
+typedef struct {
+    char name[256];
+    int method;
+    unsigned int crc;
+    unsigned int compressed_size;
+    unsigned int size;
+    unsigned int local_offset;
+} Zipentry;
+
+static unsigned int read16(const unsigned char* p) {
+    return p[0] | (p[1] << 8);
+}
+
+static unsigned int read32(const unsigned char* p) {
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((unsigned int)p[3] << 24);
+}
+
+unsigned int crc32_update(unsigned int crc, const unsigned char* data, size_t len) {
+    static unsigned int table[256];
+    static bool table_done = false;
+    if (!table_done) {
+        for (unsigned int n=0; n<256; ++n) {
+            unsigned int c = n;
+            for (int k=0; k<8; ++k) {
+                c = c & 1 ? 0xedb88320 ^ (c >> 1) : c >> 1;
+            }
+            table[n] = c;
+        }
+        table_done = true;
+    }
+    crc = ~crc;
+    for (size_t i=0; i<len; ++i) {
+        crc = table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+// inflate: the compressed stream is read from the archive in small chunks,
+// the output goes into one buffer of the (known) uncompressed size, which
+// also serves as the window for back references.
+
+#define MAX_BITS  15
+#define MAX_LCODES 286
+#define MAX_DCODES 30
+#define FIX_LCODES 288
+
+typedef struct {
+    short count[MAX_BITS+1];
+    short symbol[FIX_LCODES];
+} Huffman;
+
+typedef struct {
+    FILE* input;
+    unsigned char inbuf[16384];
+    size_t inpos;
+    size_t inlen;
+    unsigned long remaining;
+    unsigned long bitbuf;
+    int bitcnt;
+    unsigned char* out;
+    size_t outlen;
+    size_t outpos;
+    bool error;
+} Inflate;
+
+static int next_byte(Inflate* s) {
+    if (s->inpos == s->inlen) {
+        size_t want = s->remaining < sizeof(s->inbuf) ? s->remaining : sizeof(s->inbuf);
+        s->inlen = want ? fread(s->inbuf, 1, want, s->input) : 0;
+        s->inpos = 0;
+        if (s->inlen == 0) {
+            s->error = true;
+            return 0;
+        }
+        s->remaining -= s->inlen;
+    }
+    return s->inbuf[s->inpos++];
+}
+
+static int bits(Inflate* s, int need) {
+    unsigned long val = s->bitbuf;
+    while (s->bitcnt < need) {
+        val |= (unsigned long)next_byte(s) << s->bitcnt;
+        s->bitcnt += 8;
+    }
+    s->bitbuf = val >> need;
+    s->bitcnt -= need;
+    return val & ((1UL << need) - 1);
+}
+
+// canonical huffman code: count[] codes per length, symbol[] sorted by code
+static int construct(Huffman* h, const short* length, int n) {
+    short offs[MAX_BITS+1];
+    for (int len=0; len<=MAX_BITS; ++len) h->count[len] = 0;
+    for (int symbol=0; symbol<n; ++symbol) h->count[length[symbol]]++;
+    if (h->count[0] == n) return 0;
+
+    // returns > 0 for an incomplete code, < 0 for an over-subscribed one:
+    int left = 1;
+    for (int len=1; len<=MAX_BITS; ++len) {
+        left <<= 1;
+        left -= h->count[len];
+        if (left < 0) return left;
+    }
+    offs[1] = 0;
+    for (int len=1; len<MAX_BITS; ++len) {
+        offs[len+1] = offs[len] + h->count[len];
+    }
+    for (int symbol=0; symbol<n; ++symbol) {
+        if (length[symbol] != 0) h->symbol[offs[length[symbol]]++] = symbol;
+    }
+    return left;
+}
+
+static int decode(Inflate* s, const Huffman* h) {
+    int code  = 0;
+    int first = 0;
+    int index = 0;
+    for (int len=1; len<=MAX_BITS; ++len) {
+        code |= bits(s, 1);
+        int count = h->count[len];
+        if (code - count < first) return h->symbol[index + (code - first)];
+        index += count;
+        first += count;
+        first <<= 1;
+        code  <<= 1;
+    }
+    return -1;
+}
+
+static bool stored(Inflate* s) {
+    // stored blocks start on a byte boundary:
+    s->bitbuf = 0;
+    s->bitcnt = 0;
+    unsigned int len  = next_byte(s);
+    len |= next_byte(s) << 8;
+    unsigned int nlen = next_byte(s);
+    nlen |= next_byte(s) << 8;
+    if (s->error || len != (~nlen & 0xffff) || s->outpos + len > s->outlen) return false;
+    while (len--) {
+        s->out[s->outpos++] = next_byte(s);
+    }
+    return !s->error;
+}
+
+static bool codes(Inflate* s, const Huffman* lencode, const Huffman* distcode) {
+    static const short lbase[29] = {
+        3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+        35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+    static const short lext[29] = {
+        0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+        3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+    static const short dbase[30] = {
+        1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+        257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145,
+        8193, 12289, 16385, 24577 };
+    static const short dext[30] = {
+        0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+        7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+    for (;;) {
+        int symbol = decode(s, lencode);
+        if (symbol < 0 || s->error) return false;
+        if (symbol == 256) return true;
+        if (symbol < 256) {
+            if (s->outpos == s->outlen) return false;
+            s->out[s->outpos++] = symbol;
+            continue;
+        }
+        symbol -= 257;
+        if (symbol >= 29) return false;
+        size_t len = lbase[symbol] + bits(s, lext[symbol]);
+        symbol = decode(s, distcode);
+        if (symbol < 0 || symbol >= 30) return false;
+        size_t dist = dbase[symbol] + bits(s, dext[symbol]);
+        if (s->error || dist > s->outpos || s->outpos + len > s->outlen) return false;
+        // byte by byte, source and destination may overlap:
+        unsigned char* from = s->out + s->outpos - dist;
+        unsigned char* to   = s->out + s->outpos;
+        for (size_t i=0; i<len; ++i) {
+            to[i] = from[i];
+        }
+        s->outpos += len;
+    }
+}
+
+static bool fixed(Inflate* s) {
+    static Huffman lencode, distcode;
+    static bool built = false;
+    if (!built) {
+        short lengths[FIX_LCODES];
+        int symbol;
+        for (symbol=0; symbol<144; ++symbol) lengths[symbol] = 8;
+        for (; symbol<256; ++symbol) lengths[symbol] = 9;
+        for (; symbol<280; ++symbol) lengths[symbol] = 7;
+        for (; symbol<FIX_LCODES; ++symbol) lengths[symbol] = 8;
+        construct(&lencode, lengths, FIX_LCODES);
+        for (symbol=0; symbol<MAX_DCODES; ++symbol) lengths[symbol] = 5;
+        construct(&distcode, lengths, MAX_DCODES);
+        built = true;
+    }
+    return codes(s, &lencode, &distcode);
+}
+
+static bool dynamic(Inflate* s) {
+    static const short order[19] = {
+        16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+    short lengths[MAX_LCODES + MAX_DCODES];
+    Huffman lencode, distcode;
+
+    int nlen  = bits(s, 5) + 257;
+    int ndist = bits(s, 5) + 1;
+    int ncode = bits(s, 4) + 4;
+    if (nlen > MAX_LCODES || ndist > MAX_DCODES) return false;
+
+    int index;
+    for (index=0; index<ncode; ++index) lengths[order[index]] = bits(s, 3);
+    for (; index<19; ++index) lengths[order[index]] = 0;
+    if (construct(&lencode, lengths, 19) != 0) return false;
+
+    index = 0;
+    while (index < nlen + ndist) {
+        int symbol = decode(s, &lencode);
+        if (symbol < 0 || s->error) return false;
+        if (symbol < 16) {
+            lengths[index++] = symbol;
+            continue;
+        }
+        int len = 0;
+        if (symbol == 16) {
+            if (index == 0) return false;
+            len    = lengths[index - 1];
+            symbol = 3 + bits(s, 2);
+        }
+        else if (symbol == 17) {
+            symbol = 3 + bits(s, 3);
+        }
+        else {
+            symbol = 11 + bits(s, 7);
+        }
+        if (index + symbol > nlen + ndist) return false;
+        while (symbol--) lengths[index++] = len;
+    }
+
+    // a block without end-of-block code can't be decoded:
+    if (lengths[256] == 0) return false;
+    int err = construct(&lencode, lengths, nlen);
+    if (err < 0 || (err > 0 && nlen - lencode.count[0] != 1)) return false;
+    err = construct(&distcode, lengths + nlen, ndist);
+    if (err < 0 || (err > 0 && ndist - distcode.count[0] != 1)) return false;
+
+    return codes(s, &lencode, &distcode);
+}
+
+static bool inflate_entry(FILE* input, unsigned long compressed_size, unsigned char* out, size_t outlen) {
+    Inflate* s = malloc(sizeof(Inflate));
+    s->input     = input;
+    s->inpos     = 0;
+    s->inlen     = 0;
+    s->remaining = compressed_size;
+    s->bitbuf    = 0;
+    s->bitcnt    = 0;
+    s->out       = out;
+    s->outlen    = outlen;
+    s->outpos    = 0;
+    s->error     = false;
+
+    bool ok = true;
+    int last;
+    do {
+        last = bits(s, 1);
+        int type = bits(s, 2);
+        switch (type) {
+            case 0: ok = stored(s); break;
+            case 1: ok = fixed(s); break;
+            case 2: ok = dynamic(s); break;
+            default: ok = false; break;
+        }
+    } while (ok && !last && !s->error);
+    ok = ok && !s->error && s->outpos == outlen;
+    free(s);
+    return ok;
+}
+
+// reads the central directory and calls match() for every entry until it
+// returns true. Returns false if the archive is damaged.
+static bool read_central_directory(FILE* pk3, const char* filename, bool (*match)(Zipentry* entry, void* ctx), void* ctx) {
+    if (fseek(pk3, 0, SEEK_END) < 0) {
+        fprintf(stderr, "%s: %s\n", filename, strerror(errno));
+        return false;
+    }
+    long int filesize = ftell(pk3);
+    long int tail_size = filesize < ZIP_END_SIZE + ZIP_MAX_COMMENT ? filesize : ZIP_END_SIZE + ZIP_MAX_COMMENT;
+    unsigned char* tail = malloc(tail_size);
+    fseek(pk3, filesize - tail_size, SEEK_SET);
+    if (fread(tail, 1, tail_size, pk3) != (size_t)tail_size) {
+        fprintf(stderr, "%s: could not read the end of the archive!\n", filename);
+        free(tail);
+        return false;
+    }
+    // the end record sits behind the central directory, followed only by
+    // the archive comment:
+    unsigned char* end = NULL;
+    for (long int i=tail_size-ZIP_END_SIZE; i>=0; --i) {
+        if (read32(tail + i) == ZIP_END_SIG) {
+            end = tail + i;
+            break;
+        }
+    }
+    if (end == NULL) {
+        fprintf(stderr, "%s: no zip end of central directory record found!\n", filename);
+        free(tail);
+        return false;
+    }
+    unsigned int num_entries = read16(end + 10);
+    unsigned int cd_size     = read32(end + 12);
+    unsigned int cd_offset   = read32(end + 16);
+    free(tail);
+    if (cd_offset == 0xffffffff || num_entries == 0xffff) {
+        fprintf(stderr, "%s: zip64 archives are not supported!\n", filename);
+        return false;
+    }
+    if ((long int)cd_offset + cd_size > filesize) {
+        fprintf(stderr, "%s: central directory outside of the archive!\n", filename);
+        return false;
+    }
+
+    unsigned char* cd = malloc(cd_size);
+    fseek(pk3, cd_offset, SEEK_SET);
+    if (fread(cd, 1, cd_size, pk3) != cd_size) {
+        fprintf(stderr, "%s: could not read the central directory!\n", filename);
+        free(cd);
+        return false;
+    }
+    unsigned int pos = 0;
+    for (unsigned int i=0; i<num_entries; ++i) {
+        if (pos + ZIP_CENTRAL_SIZE > cd_size || read32(cd + pos) != ZIP_CENTRAL_SIG) {
+            fprintf(stderr, "%s: damaged central directory!\n", filename);
+            free(cd);
+            return false;
+        }
+        unsigned char* e = cd + pos;
+        unsigned int name_len    = read16(e + 28);
+        unsigned int extra_len   = read16(e + 30);
+        unsigned int comment_len = read16(e + 32);
+        if (pos + ZIP_CENTRAL_SIZE + name_len > cd_size) {
+            fprintf(stderr, "%s: damaged central directory!\n", filename);
+            free(cd);
+            return false;
+        }
+        Zipentry entry;
+        entry.method          = read16(e + 10);
+        entry.crc             = read32(e + 16);
+        entry.compressed_size = read32(e + 20);
+        entry.size            = read32(e + 24);
+        entry.local_offset    = read32(e + 42);
+        size_t n = name_len < sizeof(entry.name) ? name_len : sizeof(entry.name) - 1;
+        memcpy(entry.name, e + ZIP_CENTRAL_SIZE, n);
+        entry.name[n] = '\0';
+        if (match(&entry, ctx)) break;
+        pos += ZIP_CENTRAL_SIZE + name_len + extra_len + comment_len;
+    }
+    free(cd);
+    return true;
+}
+
+static bool is_map_entry(Zipentry* entry) {
+    size_t len = strlen(entry->name);
+    return len > 9 && strncasecmp(entry->name, "maps/", 5) == 0 && strcasecmp(entry->name + len - 4, ".wad") == 0;
+}
+
+typedef struct {
+    const char* mapname;
+    Zipentry entry;
+    bool found;
+} Mapsearch;
+
+static bool match_map(Zipentry* entry, void* ctx) {
+    Mapsearch* search = ctx;
+    if (!is_map_entry(entry)) return false;
+    size_t len = strlen(entry->name) - 9;
+    if (strlen(search->mapname) != len || strncasecmp(entry->name + 5, search->mapname, len) != 0) return false;
+    search->entry = *entry;
+    search->found = true;
+    return true;
+}
+
+static bool print_map(Zipentry* entry, void* ctx) {
+    int* num_maps = ctx;
+    if (is_map_entry(entry)) {
+        printf("%s (size: %u)\n", entry->name, entry->size);
+        (*num_maps)++;
+    }
+    return false;
+}
+
+bool is_pk3(const Header* header) {
+    return read32((const unsigned char*)header->identification) == ZIP_LOCAL_SIG;
+}
+
+bool list_pk3_maps(FILE* pk3, const char* filename) {
+    int num_maps = 0;
+    printf("Reading %s (pk3)...\n", filename);
+    if (!read_central_directory(pk3, filename, print_map, &num_maps)) return false;
+    printf("%d map%s found\n", num_maps, num_maps!=1 ? "s" : "");
+    return true;
+}
+
+// inflates maps/<mapname>.wad from the archive. Returns a read-only stream
+// over the WAD in memory, *buffer has to be freed after closing it.
+FILE* open_pk3_map(FILE* pk3, const char* filename, const char* mapname, unsigned char** buffer) {
+    Mapsearch search;
+    search.mapname = mapname;
+    search.found   = false;
+    if (!read_central_directory(pk3, filename, match_map, &search)) return NULL;
+    if (!search.found) {
+        fprintf(stderr, "maps/%s.wad not found in %s!\n", mapname, filename);
+        return NULL;
+    }
+    Zipentry* entry = &search.entry;
+    if (entry->method != ZIP_STORED && entry->method != ZIP_DEFLATE) {
+        fprintf(stderr, "%s: unsupported compression method %d for %s!\n", filename, entry->method, entry->name);
+        return NULL;
+    }
+    // 0xffffffff: the real sizes are in a zip64 extra field
+    if (entry->size == 0xffffffff || entry->compressed_size == 0xffffffff) {
+        fprintf(stderr, "%s: zip64 entries are not supported (%s)!\n", filename, entry->name);
+        return NULL;
+    }
+
+    unsigned char local[ZIP_LOCAL_SIZE];
+    if (fseek(pk3, entry->local_offset, SEEK_SET) < 0 ||
+            fread(local, 1, ZIP_LOCAL_SIZE, pk3) != ZIP_LOCAL_SIZE ||
+            read32(local) != ZIP_LOCAL_SIG) {
+        fprintf(stderr, "%s: damaged local header for %s!\n", filename, entry->name);
+        return NULL;
+    }
+    // the local name and extra field can differ from the central directory:
+    long int data_offset = entry->local_offset + ZIP_LOCAL_SIZE + read16(local + 26) + read16(local + 28);
+    fseek(pk3, data_offset, SEEK_SET);
+
+    // + 1 so an empty entry still gets a buffer for fmemopen():
+    unsigned char* data = malloc((size_t)entry->size + 1);
+    if (data == NULL) {
+        fprintf(stderr, "%s: out of memory for %s (%u bytes)!\n", filename, entry->name, entry->size);
+        return NULL;
+    }
+    bool ok;
+    if (entry->method == ZIP_STORED) {
+        ok = entry->compressed_size == entry->size && fread(data, 1, entry->size, pk3) == entry->size;
+    }
+    else {
+        ok = inflate_entry(pk3, entry->compressed_size, data, entry->size);
+    }
+    if (!ok) {
+        fprintf(stderr, "%s: could not decompress %s!\n", filename, entry->name);
+        free(data);
+        return NULL;
+    }
+    if (crc32_update(0, data, entry->size) != entry->crc) {
+        fprintf(stderr, "%s: crc mismatch in %s!\n", filename, entry->name);
+        free(data);
+        return NULL;
+    }
+
+    FILE* wadfile = fmemopen(data, entry->size, "rb");
+    if (wadfile == NULL) {
+        fprintf(stderr, "open_pk3_map(): %s\n", strerror(errno));
+        free(data);
+        return NULL;
+    }
+    *buffer = data;
+    return wadfile;
+}
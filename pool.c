@@ -0,0 +1,76 @@
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <unistd.h>
+#include "map2img.h"
+
+// a minimal thread pool: every worker pulls the next job index from a
+// shared counter until all jobs are done, so uneven job sizes (e.g. small
+// and huge WADs) still keep all threads busy.
+
+typedef struct {
+    pool_job job;
+    void* ctx;
+    int num_jobs;
+    int next_job;
+    pthread_mutex_t lock;
+} Pool;
+
+typedef struct {
+    Pool* pool;
+    int thread;
+} Worker;
+
+static void* pool_worker(void* arg) {
+    Worker* worker = arg;
+    Pool* pool = worker->pool;
+    for (;;) {
+        pthread_mutex_lock(&pool->lock);
+        int index = pool->next_job++;
+        pthread_mutex_unlock(&pool->lock);
+        if (index >= pool->num_jobs) break;
+        pool->job(index, worker->thread, pool->ctx);
+    }
+    return NULL;
+}
+
+int pool_default_threads(void) {
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return n < 1 ? 1 : (int)n;
+}
+
+void run_pool(int num_jobs, int num_threads, pool_job job, void* ctx) {
+    if (num_threads < 1) num_threads = pool_default_threads();
+    if (num_threads > num_jobs) num_threads = num_jobs;
+    if (num_threads <= 1) {
+        for (int i=0; i<num_jobs; ++i) {
+            job(i, 0, ctx);
+        }
+        return;
+    }
+
+    Pool pool = { job, ctx, num_jobs, 0 };
+    pthread_mutex_init(&pool.lock, NULL);
+    pthread_t* threads = malloc(num_threads * sizeof(pthread_t));
+    Worker* workers    = malloc(num_threads * sizeof(Worker));
+    // the calling thread works as thread 0:
+    for (int i=1; i<num_threads; ++i) {
+        workers[i].pool   = &pool;
+        workers[i].thread = i;
+        if (pthread_create(&threads[i], NULL, pool_worker, &workers[i]) != 0) {
+            fprintf(stderr, "run_pool(): could not create thread %d, continuing with %d\n", i, i);
+            num_threads = i;
+            break;
+        }
+    }
+    workers[0].pool   = &pool;
+    workers[0].thread = 0;
+    pool_worker(&workers[0]);
+    for (int i=1; i<num_threads; ++i) {
+        pthread_join(threads[i], NULL);
+    }
+    pthread_mutex_destroy(&pool.lock);
+    free(workers);
+    free(threads);
+}
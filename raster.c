@@ -0,0 +1,661 @@
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <math.h>
+#include "map2img.h"
+
+// png output: automap style raster image with the floors textured.
+// Every sector is scanline filled with its 64x64 floor flat, shaded by its
+// light level, then the linedefs (and things) are drawn on top with the
+// same classification as the svg output.
+// https://doomwiki.org/wiki/Flat
+// https://doomwiki.org/wiki/PLAYPAL
+
+#define FLAT_SIZE 64
+#define LIGHT_LEVELS 32
+#define MISSING_FLAT_COLOR 0x404040
+// 8192x8192, 256 MB of pixels plus the png buffers
+#define PNG_MAX_PIXELS (1 << 26)
+
+typedef struct {
+    char name[8];
+    int lump;            // index into the lump directory, -1: empty slot
+    unsigned char* data; // palette indices, NULL until first used
+} Flatslot;
+
+// decoded once per WAD and kept for all of its maps
+struct Flatcache {
+    unsigned int palettes[LIGHT_LEVELS][256]; // RGBA (in memory order) per light level
+    Flatslot* slots;
+    int num_slots;       // power of two
+    FILE* wadfile;
+};
+
+typedef struct {
+    float x;
+    float y;
+} Point;
+
+typedef struct {
+    Point a;
+    Point b;
+} Edge;
+
+// pixels are stored as 0xAABBGGRR, i.e. R, G, B, A in memory
+static unsigned int rgba(unsigned int r, unsigned int g, unsigned int b) {
+    return r | (g << 8) | (b << 16) | 0xff000000;
+}
+
+static unsigned int rgb_to_rgba(unsigned int rgb) {
+    return rgba((rgb >> 16) & 0xff, (rgb >> 8) & 0xff, rgb & 0xff);
+}
+
+static unsigned int hash_name(const char* name) {
+    unsigned int h = 2166136261u;
+    for (int i=0; i<8 && name[i]; ++i) {
+        char c = name[i];
+        if (c >= 'a' && c <= 'z') c -= 'a' - 'A';
+        h = (h ^ (unsigned char)c) * 16777619u;
+    }
+    return h;
+}
+
+static bool same_name(const char* a, const char* b) {
+    return strncasecmp(a, b, 8) == 0;
+}
+
+static Flatslot* find_flat(Flatcache* flats, const char* name) {
+    unsigned int mask = flats->num_slots - 1;
+    for (unsigned int i=hash_name(name) & mask; ; i=(i+1) & mask) {
+        Flatslot* slot = &flats->slots[i];
+        if (slot->lump < 0) return slot;
+        if (same_name(slot->name, name)) return slot;
+    }
+}
+
+static bool is_flat_marker(const char* name, const char* marker) {
+    // F_START/FF_START (PWADs), F_END/FF_END:
+    return strncmp(name, marker, 8) == 0 || (name[0] == 'F' && strncmp(name+1, marker, 7) == 0);
+}
+
+// indexes all flats between the F_START/F_END markers and decodes PLAYPAL.
+// Flat data is only read when a sector uses it.
+static Flatcache* load_flatcache(Wadinfo* wadinfo) {
+    Flatcache* flats = malloc(sizeof(Flatcache));
+    flats->wadfile = wadinfo->wadfile;
+    Direntry* directory = wadinfo->directory;
+    int num_lumps = wadinfo->header.num_lumps;
+
+    int num_flats = 0;
+    bool in_flats = false;
+    unsigned char* playpal = NULL;
+    for (int i=0; i<num_lumps; ++i) {
+        if (is_flat_marker(directory[i].name, "F_START")) in_flats = true;
+        else if (is_flat_marker(directory[i].name, "F_END")) in_flats = false;
+        else if (in_flats && directory[i].size == FLAT_SIZE * FLAT_SIZE) num_flats++;
+        else if (strncmp(directory[i].name, "PLAYPAL", 8) == 0 && directory[i].size >= 768 && playpal == NULL) {
+            playpal = read_lump(wadinfo->wadfile, &directory[i], NULL);
+        }
+    }
+
+    flats->num_slots = 16;
+    while (flats->num_slots < num_flats * 2) flats->num_slots *= 2;
+    flats->slots = malloc(flats->num_slots * sizeof(Flatslot));
+    for (int i=0; i<flats->num_slots; ++i) {
+        flats->slots[i].lump = -1;
+        flats->slots[i].data = NULL;
+    }
+    in_flats = false;
+    for (int i=0; i<num_lumps; ++i) {
+        if (is_flat_marker(directory[i].name, "F_START")) in_flats = true;
+        else if (is_flat_marker(directory[i].name, "F_END")) in_flats = false;
+        else if (in_flats && directory[i].size == FLAT_SIZE * FLAT_SIZE) {
+            // later lumps replace earlier ones with the same name:
+            Flatslot* slot = find_flat(flats, directory[i].name);
+            memcpy(slot->name, directory[i].name, 8);
+            slot->lump = i;
+        }
+    }
+
+    if (playpal == NULL) {
+        fprintf(stderr, "no PLAYPAL in %s, using a grey palette\n", wadinfo->filename);
+    }
+    for (int light=0; light<LIGHT_LEVELS; ++light) {
+        unsigned int factor = light + 1;
+        for (int i=0; i<256; ++i) {
+            unsigned int r = playpal ? playpal[3*i]   : i;
+            unsigned int g = playpal ? playpal[3*i+1] : i;
+            unsigned int b = playpal ? playpal[3*i+2] : i;
+            flats->palettes[light][i] = rgba(r * factor / LIGHT_LEVELS, g * factor / LIGHT_LEVELS, b * factor / LIGHT_LEVELS);
+        }
+    }
+    free(playpal);
+    return flats;
+}
+
+void free_flatcache(Flatcache* flats) {
+    if (flats == NULL) return;
+    for (int i=0; i<flats->num_slots; ++i) {
+        free(flats->slots[i].data);
+    }
+    free(flats->slots);
+    free(flats);
+}
+
+static const unsigned char* get_flat(Flatcache* flats, Direntry* directory, const char* name) {
+    Flatslot* slot = find_flat(flats, name);
+    if (slot->lump < 0) return NULL;
+    if (slot->data == NULL) {
+        slot->data = read_lump(flats->wadfile, &directory[slot->lump], NULL);
+    }
+    return slot->data;
+}
+
+unsigned int output_png_needs(Imginfo* imginfo) {
+    unsigned int needs = NEED(LUMP_LINEDEFS) | NEED(LUMP_VERTEXES) | NEED(LUMP_SIDEDEFS) | NEED(LUMP_SECTORS);
+    if (imginfo->draw_things) needs |= NEED(LUMP_THINGS);
+    return needs;
+}
+
+// the inner loop of the sector fill: one texel row of the flat, the u
+// coordinate in 16.16 fixed point. No dependencies between the pixels, so
+// the compiler can vectorize it (gather + store).
+static void fill_span(unsigned int* restrict dst, int count, const unsigned char* restrict row,
+        const unsigned int* restrict palette, unsigned int u, unsigned int du) {
+    for (int i=0; i<count; ++i) {
+        dst[i] = palette[row[((u + i*du) >> 16) & (FLAT_SIZE-1)]];
+    }
+}
+
+static void fill_solid(unsigned int* dst, size_t count, unsigned int color) {
+    for (size_t i=0; i<count; ++i) {
+        dst[i] = color;
+    }
+}
+
+static int compare_floats(const void* a, const void* b) {
+    float x = *(const float*)a;
+    float y = *(const float*)b;
+    return (x > y) - (x < y);
+}
+
+typedef struct {
+    unsigned int* pixels;
+    int width;
+    int height;
+} Image;
+
+// even-odd scanline fill of one sector, edges are in image coordinates
+static void fill_sector(Imginfo* imginfo, Image* image, Edge* edges, int num_edges, float* crossings,
+        const unsigned char* flat, const unsigned int* palette) {
+    float min_y = edges[0].a.y, max_y = edges[0].a.y;
+    for (int i=0; i<num_edges; ++i) {
+        if (edges[i].a.y < min_y) min_y = edges[i].a.y;
+        if (edges[i].b.y < min_y) min_y = edges[i].b.y;
+        if (edges[i].a.y > max_y) max_y = edges[i].a.y;
+        if (edges[i].b.y > max_y) max_y = edges[i].b.y;
+    }
+    int y_start = (int)ceilf(min_y - 0.5f);
+    int y_end   = (int)ceilf(max_y - 0.5f);
+    if (y_start < 0) y_start = 0;
+    if (y_end > image->height) y_end = image->height;
+
+    // texture coordinates: back from image to map space
+    double inv_scale = 1.0 / imginfo->scale;
+    unsigned int du = (unsigned int)(inv_scale * 65536.0);
+
+    for (int y=y_start; y<y_end; ++y) {
+        float yc = y + 0.5f;
+        int num_crossings = 0;
+        for (int i=0; i<num_edges; ++i) {
+            Point a = edges[i].a;
+            Point b = edges[i].b;
+            if ((a.y <= yc && b.y > yc) || (b.y <= yc && a.y > yc)) {
+                crossings[num_crossings++] = a.x + (yc - a.y) * (b.x - a.x) / (b.y - a.y);
+            }
+        }
+        if (num_crossings < 2) continue;
+        qsort(crossings, num_crossings, sizeof(float), compare_floats);
+
+        double map_y = imginfo->max_y - (yc - imginfo->padding) * inv_scale;
+        const unsigned char* row = flat ? flat + ((int)floor(-map_y) & (FLAT_SIZE-1)) * FLAT_SIZE : NULL;
+        unsigned int* line = image->pixels + (size_t)y * image->width;
+        for (int i=0; i+1<num_crossings; i+=2) {
+            int x_start = (int)ceilf(crossings[i] - 0.5f);
+            int x_end   = (int)ceilf(crossings[i+1] - 0.5f);
+            if (x_start < 0) x_start = 0;
+            if (x_end > image->width) x_end = image->width;
+            if (x_end <= x_start) continue;
+            if (row == NULL) {
+                fill_solid(line + x_start, x_end - x_start, rgb_to_rgba(MISSING_FLAT_COLOR));
+                continue;
+            }
+            // wrapped into one flat first, so the fixed point value can't
+            // overflow in a way that changes the texel:
+            double map_x = (x_start + 0.5 - imginfo->padding) * inv_scale - imginfo->x_off;
+            double wrapped = map_x - FLAT_SIZE * floor(map_x / FLAT_SIZE);
+            fill_span(line + x_start, x_end - x_start, row, palette, (unsigned int)(wrapped * 65536.0), du);
+        }
+    }
+}
+
+static void draw_line(Image* image, int x0, int y0, int x1, int y1, unsigned int color) {
+    int dx = abs(x1 - x0), sx = x0 < x1 ? 1 : -1;
+    int dy = -abs(y1 - y0), sy = y0 < y1 ? 1 : -1;
+    int err = dx + dy;
+    for (;;) {
+        if (x0 >= 0 && x0 < image->width && y0 >= 0 && y0 < image->height) {
+            image->pixels[(size_t)y0 * image->width + x0] = color;
+        }
+        if (x0 == x1 && y0 == y1) break;
+        int e2 = 2 * err;
+        if (e2 >= dy) { err += dy; x0 += sx; }
+        if (e2 <= dx) { err += dx; y0 += sy; }
+    }
+}
+
+static void draw_disc(Image* image, float cx, float cy, float r, unsigned int color) {
+    if (r < 1) r = 1;
+    int y_start = (int)floorf(cy - r), y_end = (int)ceilf(cy + r);
+    for (int y=y_start; y<=y_end; ++y) {
+        if (y < 0 || y >= image->height) continue;
+        float dy = y + 0.5f - cy;
+        if (dy*dy > r*r) continue;
+        float dx = sqrtf(r*r - dy*dy);
+        int x_start = (int)ceilf(cx - dx - 0.5f), x_end = (int)ceilf(cx + dx - 0.5f);
+        if (x_start < 0) x_start = 0;
+        if (x_end > image->width) x_end = image->width;
+        if (x_end > x_start) fill_solid(image->pixels + (size_t)y * image->width + x_start, x_end - x_start, color);
+    }
+}
+
+// the sectors on both sides of a linedef, -1 for a missing side
+static void linedef_sectors(Wadinfo* wadinfo, Linedef* linedef, int* sector_front, int* sector_back) {
+    unsigned short front = linedef->f_sidenum;
+    unsigned short back  = linedef->b_sidenum;
+    *sector_front = front < wadinfo->num_sidedefs ? wadinfo->sidedefs[front].sector : -1;
+    *sector_back  = back  < wadinfo->num_sidedefs ? wadinfo->sidedefs[back].sector  : -1;
+    if (*sector_front >= wadinfo->num_sectors) *sector_front = -1;
+    if (*sector_back  >= wadinfo->num_sectors) *sector_back  = -1;
+}
+
+static void render_floors(Imginfo* imginfo, Wadinfo* wadinfo, Image* image) {
+    long int num_sectors = wadinfo->num_sectors;
+
+    // sort the edges by sector (counting sort): a linedef is an edge of the
+    // sectors on both of its sides, unless both sides are the same sector
+    int* counts = calloc(num_sectors + 1, sizeof(int));
+    for (long int i=0; i<wadinfo->num_linedefs; ++i) {
+        int sector_front, sector_back;
+        linedef_sectors(wadinfo, &wadinfo->linedefs[i], &sector_front, &sector_back);
+        if (sector_front == sector_back) continue;
+        if (sector_front >= 0) counts[sector_front + 1]++;
+        if (sector_back  >= 0) counts[sector_back + 1]++;
+    }
+    for (long int i=1; i<=num_sectors; ++i) counts[i] += counts[i-1];
+
+    long int num_edges = counts[num_sectors];
+    Edge* edges = malloc((num_edges + 1) * sizeof(Edge));
+    int* fill = malloc((num_sectors + 1) * sizeof(int));
+    memcpy(fill, counts, (num_sectors + 1) * sizeof(int));
+    for (long int i=0; i<wadinfo->num_linedefs; ++i) {
+        Linedef* l = &wadinfo->linedefs[i];
+        int sector_front, sector_back;
+        linedef_sectors(wadinfo, l, &sector_front, &sector_back);
+        if (sector_front == sector_back) continue;
+        Vertex start = wadinfo->vertexes[(unsigned short)l->v_start];
+        Vertex end   = wadinfo->vertexes[(unsigned short)l->v_end];
+        Edge e;
+        e.a.x = imginfo->padding + (start.x + imginfo->x_off) * imginfo->scale;
+        e.a.y = imginfo->padding + (imginfo->max_y - start.y) * imginfo->scale;
+        e.b.x = imginfo->padding + (end.x + imginfo->x_off) * imginfo->scale;
+        e.b.y = imginfo->padding + (imginfo->max_y - end.y) * imginfo->scale;
+        if (sector_front >= 0) edges[fill[sector_front]++] = e;
+        if (sector_back  >= 0) edges[fill[sector_back]++] = e;
+    }
+    free(fill);
+
+    int max_edges = 0;
+    for (long int s=0; s<num_sectors; ++s) {
+        if (counts[s+1] - counts[s] > max_edges) max_edges = counts[s+1] - counts[s];
+    }
+    float* crossings = malloc((max_edges + 1) * sizeof(float));
+    for (long int s=0; s<num_sectors; ++s) {
+        int first = counts[s];
+        int n = counts[s+1] - first;
+        if (n < 2) continue;
+        Sector* sector = &wadinfo->sectors[s];
+        const unsigned char* flat = get_flat(wadinfo->flats, wadinfo->directory, sector->floor_texture);
+        int light = sector->light_level < 0 ? 0 : sector->light_level > 255 ? 255 : sector->light_level;
+        fill_sector(imginfo, image, edges + first, n, crossings, flat, wadinfo->flats->palettes[light * LIGHT_LEVELS / 256]);
+    }
+    free(crossings);
+    free(edges);
+    free(counts);
+}
+
+static unsigned int adler32_update(unsigned int adler, const unsigned char* data, size_t len) {
+    unsigned int a = adler & 0xffff, b = adler >> 16;
+    // 5552 bytes is the most that can be summed before b overflows 32 bits:
+    while (len > 0) {
+        size_t n = len < 5552 ? len : 5552;
+        for (size_t i=0; i<n; ++i) {
+            a += data[i];
+            b += a;
+        }
+        a %= 65521;
+        b %= 65521;
+        data += n;
+        len  -= n;
+    }
+    return (b << 16) | a;
+}
+
+static void put32(unsigned char* p, unsigned int v) {
+    p[0] = v >> 24;
+    p[1] = v >> 16;
+    p[2] = v >> 8;
+    p[3] = v;
+}
+
+static void write_chunk(FILE* output, const char* type, const unsigned char* data, size_t len) {
+    unsigned char head[8];
+    put32(head, len);
+    memcpy(head + 4, type, 4);
+    fwrite(head, 1, 8, output);
+    if (len) fwrite(data, 1, len, output);
+    unsigned int crc = crc32_update(0, head + 4, 4);
+    crc = crc32_update(crc, data, len);
+    unsigned char tail[4];
+    put32(tail, crc);
+    fwrite(tail, 1, 4, output);
+}
+
+// deflate (RFC 1951) with the fixed Huffman codes and greedy LZ77 matches
+// from hash chains. The floors repeat their flat every 64 pixels and most
+// of the rest is black, so this gets close to zlib at a fraction of the
+// code. https://www.rfc-editor.org/rfc/rfc1951
+#define LZ_WINDOW    32768
+#define LZ_HASH_BITS 15
+#define LZ_MIN_MATCH 3
+#define LZ_MAX_MATCH 258
+#define LZ_MAX_CHAIN 16
+
+static const unsigned short length_base[29] = {
+    3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+    35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+static const unsigned char length_extra[29] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+static const unsigned short dist_base[30] = {
+    1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+    257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+static const unsigned char dist_extra[30] = {
+    0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+typedef struct {
+    unsigned char* out;
+    size_t pos;
+    unsigned long long bits;
+    int num_bits;
+} Bitwriter;
+
+// deflate packs bits starting at the least significant one
+static void put_bits(Bitwriter* w, unsigned int value, int n) {
+    w->bits |= (unsigned long long)value << w->num_bits;
+    w->num_bits += n;
+    while (w->num_bits >= 8) {
+        w->out[w->pos++] = w->bits;
+        w->bits >>= 8;
+        w->num_bits -= 8;
+    }
+}
+
+// ... but Huffman codes start with their most significant bit
+static void put_code(Bitwriter* w, unsigned int code, int n) {
+    unsigned int reversed = 0;
+    for (int i=0; i<n; ++i) {
+        reversed = (reversed << 1) | ((code >> i) & 1);
+    }
+    put_bits(w, reversed, n);
+}
+
+// fixed literal/length code of symbol 0..287
+static void put_symbol(Bitwriter* w, int symbol) {
+    if (symbol < 144)      put_code(w, 0x30 + symbol, 8);
+    else if (symbol < 256) put_code(w, 0x190 + symbol - 144, 9);
+    else if (symbol < 280) put_code(w, symbol - 256, 7);
+    else                   put_code(w, 0xc0 + symbol - 280, 8);
+}
+
+static void put_match(Bitwriter* w, int length, int distance) {
+    int l = 28;
+    while (length_base[l] > length) l--;
+    put_symbol(w, 257 + l);
+    put_bits(w, length - length_base[l], length_extra[l]);
+    int d = 29;
+    while (dist_base[d] > distance) d--;
+    put_code(w, d, 5);
+    put_bits(w, distance - dist_base[d], dist_extra[d]);
+}
+
+static unsigned int lz_hash(const unsigned char* p) {
+    return ((p[0] << 16 | p[1] << 8 | p[2]) * 2654435761u) >> (32 - LZ_HASH_BITS);
+}
+
+// the most a zlib stream of len bytes can take: no symbol is longer than
+// 9 bits per input byte
+static size_t zlib_bound(size_t len) {
+    return len + len / 8 + 16;
+}
+
+// zlib stream (header, one fixed Huffman block, adler32) of data into out,
+// returns its size or 0 if there was no memory for the hash chains
+static size_t zlib_compress(const unsigned char* data, size_t len, unsigned char* out) {
+    long int* head = malloc((1 << LZ_HASH_BITS) * sizeof(long int));
+    long int* prev = malloc(LZ_WINDOW * sizeof(long int));
+    if (head == NULL || prev == NULL) {
+        free(head);
+        free(prev);
+        return 0;
+    }
+    for (int i=0; i<(1 << LZ_HASH_BITS); ++i) {
+        head[i] = -1;
+    }
+    Bitwriter w = { out, 0, 0, 0 };
+    w.out[w.pos++] = 0x78;
+    w.out[w.pos++] = 0x01;
+    put_bits(&w, 1, 1); // last block
+    put_bits(&w, 1, 2); // fixed Huffman codes
+
+    size_t i = 0;
+    while (i < len) {
+        size_t best_len = 0, best_dist = 0;
+        if (len - i >= LZ_MIN_MATCH) {
+            size_t max_len = len - i < LZ_MAX_MATCH ? len - i : LZ_MAX_MATCH;
+            long int candidate = head[lz_hash(data + i)];
+            for (int chain=0; candidate >= 0 && i - candidate <= LZ_WINDOW && chain < LZ_MAX_CHAIN; ++chain) {
+                // the byte after the best match so far decides most candidates:
+                if (data[candidate + best_len] == data[i + best_len]) {
+                    size_t n = 0;
+                    while (n < max_len && data[candidate + n] == data[i + n]) n++;
+                    if (n > best_len) {
+                        best_len  = n;
+                        best_dist = i - candidate;
+                        if (n == max_len) break;
+                    }
+                }
+                long int next = prev[candidate & (LZ_WINDOW - 1)];
+                if (next >= candidate) break;
+                candidate = next;
+            }
+        }
+        size_t step = 1;
+        if (best_len >= LZ_MIN_MATCH) {
+            put_match(&w, best_len, best_dist);
+            step = best_len;
+        }
+        else {
+            put_symbol(&w, data[i]);
+        }
+        for (size_t end=i+step; i<end; ++i) {
+            if (len - i < LZ_MIN_MATCH) continue;
+            unsigned int h = lz_hash(data + i);
+            prev[i & (LZ_WINDOW - 1)] = head[h];
+            head[h] = i;
+        }
+    }
+    put_symbol(&w, 256); // end of block
+    if (w.num_bits > 0) put_bits(&w, 0, 8 - w.num_bits);
+    put32(w.out + w.pos, adler32_update(1, data, len));
+    free(head);
+    free(prev);
+    return w.pos + 4;
+}
+
+// png filter of one row: 0 none, 1 sub, 2 up (3 bytes per pixel)
+static void filter_row(int type, const unsigned char* row, const unsigned char* above, size_t len, unsigned char* out) {
+    for (size_t i=0; i<len; ++i) {
+        unsigned char left = i >= 3 ? row[i - 3] : 0;
+        out[i] = type == 0 ? row[i] : type == 1 ? row[i] - left : row[i] - above[i];
+    }
+}
+
+// the usual heuristic: the filter with the smallest sum of (signed) bytes
+static unsigned int filter_cost(const unsigned char* out, size_t len) {
+    unsigned int cost = 0;
+    for (size_t i=0; i<len; ++i) {
+        cost += out[i] < 128 ? out[i] : 256 - out[i];
+    }
+    return cost;
+}
+
+// RGB png, every row with the filter that suits it best, then deflated:
+// https://www.w3.org/TR/png/
+static bool write_png(Image* image, FILE* output) {
+    // filter byte + RGB per row:
+    size_t line_size = 3 * (size_t)image->width;
+    size_t row_size  = 1 + line_size;
+    size_t raw_size  = row_size * image->height;
+    unsigned char* raw   = malloc(raw_size);
+    unsigned char* zlib  = malloc(zlib_bound(raw_size));
+    unsigned char* lines = calloc(5, line_size);  // current, above and three filtered
+    if (raw == NULL || zlib == NULL || lines == NULL) {
+        fprintf(stderr, "write_png(): out of memory for %dx%d pixels!\n", image->width, image->height);
+        free(raw);
+        free(zlib);
+        free(lines);
+        return false;
+    }
+    unsigned char* line  = lines;
+    unsigned char* above = lines + line_size;
+    unsigned char* filtered[3] = { lines + 2 * line_size, lines + 3 * line_size, lines + 4 * line_size };
+    for (int y=0; y<image->height; ++y) {
+        unsigned int* pixels = image->pixels + (size_t)y * image->width;
+        for (int x=0; x<image->width; ++x) {
+            line[3*x]     = pixels[x];
+            line[3*x + 1] = pixels[x] >> 8;
+            line[3*x + 2] = pixels[x] >> 16;
+        }
+        int best = 0;
+        unsigned int best_cost = 0;
+        for (int type=0; type<3; ++type) {
+            filter_row(type, line, above, line_size, filtered[type]);
+            unsigned int cost = filter_cost(filtered[type], line_size);
+            if (type == 0 || cost < best_cost) {
+                best = type;
+                best_cost = cost;
+            }
+        }
+        unsigned char* row = raw + y * row_size;
+        row[0] = best;
+        memcpy(row + 1, filtered[best], line_size);
+        unsigned char* swap = above;
+        above = line;
+        line  = swap;
+    }
+    size_t zlib_size = zlib_compress(raw, raw_size, zlib);
+    free(lines);
+    free(raw);
+    if (zlib_size == 0) {
+        fprintf(stderr, "write_png(): out of memory for %dx%d pixels!\n", image->width, image->height);
+        free(zlib);
+        return false;
+    }
+
+    static const unsigned char signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+    fwrite(signature, 1, 8, output);
+    unsigned char ihdr[13];
+    put32(ihdr, image->width);
+    put32(ihdr + 4, image->height);
+    ihdr[8]  = 8; // bit depth
+    ihdr[9]  = 2; // RGB
+    ihdr[10] = 0;
+    ihdr[11] = 0;
+    ihdr[12] = 0;
+    write_chunk(output, "IHDR", ihdr, sizeof(ihdr));
+    write_chunk(output, "IDAT", zlib, zlib_size);
+    write_chunk(output, "IEND", NULL, 0);
+    free(zlib);
+    return true;
+}
+
+// for images that aren't maps, pixels are 0xAABBGGRR like rgba() makes them
+bool write_rgb_png(const unsigned int* pixels, int width, int height, FILE* output) {
+    Image image = { (unsigned int*)pixels, width, height };
+    return write_png(&image, output);
+}
+
+bool output_png(Imginfo* imginfo, Wadinfo* wadinfo, FILE* output) {
+    if (wadinfo->flats == NULL) {
+        if (!read_directory(wadinfo)) return false;
+        wadinfo->flats = load_flatcache(wadinfo);
+    }
+
+    double width  = ceil(imginfo->width * imginfo->scale + 2 * imginfo->padding);
+    double height = ceil(imginfo->height * imginfo->scale + 2 * imginfo->padding);
+    if (width < 1) width = 1;
+    if (height < 1) height = 1;
+    if (width * height > PNG_MAX_PIXELS) {
+        fprintf(stderr, "ERROR: %s would be %.0fx%.0f pixels, at most %d are supported (use a smaller -s)!\n",
+                wadinfo->mapname, width, height, PNG_MAX_PIXELS);
+        return false;
+    }
+    Image image;
+    image.width  = (int)width;
+    image.height = (int)height;
+    size_t num_pixels = (size_t)image.width * image.height;
+    image.pixels = malloc(num_pixels * sizeof(unsigned int));
+    if (image.pixels == NULL) {
+        fprintf(stderr, "output_png(): out of memory for %dx%d pixels!\n", image.width, image.height);
+        return false;
+    }
+    fill_solid(image.pixels, num_pixels, rgba(0, 0, 0));
+
+    render_floors(imginfo, wadinfo, &image);
+
+    for (long int i=0; i<wadinfo->num_linedefs; ++i) {
+        Vertex start = wadinfo->vertexes[(unsigned short)wadinfo->linedefs[i].v_start];
+        Vertex end   = wadinfo->vertexes[(unsigned short)wadinfo->linedefs[i].v_end];
+        draw_line(&image,
+                (int)floorf(imginfo->padding + (start.x + imginfo->x_off) * imginfo->scale),
+                (int)floorf(imginfo->padding + (imginfo->max_y - start.y) * imginfo->scale),
+                (int)floorf(imginfo->padding + (end.x + imginfo->x_off) * imginfo->scale),
+                (int)floorf(imginfo->padding + (imginfo->max_y - end.y) * imginfo->scale),
+                rgb_to_rgba(linestyles[wadinfo->line_classes[i]].rgb));
+    }
+    if (imginfo->draw_things) {
+        for (long int i=0; i<wadinfo->num_things; ++i) {
+            const Thingstyle* style = &thingstyles[wadinfo->thing_classes[i]];
+            draw_disc(&image,
+                    imginfo->padding + (wadinfo->things[i].x_pos + imginfo->x_off) * imginfo->scale,
+                    imginfo->padding + (imginfo->max_y - wadinfo->things[i].y_pos) * imginfo->scale,
+                    style->size * imginfo->scale, rgb_to_rgba(style->rgb));
+        }
+    }
+
+    bool ok = write_png(&image, output);
+    free(image.pixels);
+    return ok;
+}
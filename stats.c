@@ -0,0 +1,151 @@
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include "map2img.h"
+
+// --stats-only: aggregates over the linedef, vertex and thing arrays of
+// every map in one pass each and writes JSON, nothing gets rendered.
+
+// https://doomwiki.org/wiki/Thing#Flags
+#define THING_EASY        0x01
+#define THING_MEDIUM      0x02
+#define THING_HARD        0x04
+#define THING_MULTIPLAYER 0x10
+
+#define MAX_MONSTER_TYPES 64
+
+typedef struct {
+    int16_t type;
+    int total;
+    int easy;
+    int medium;
+    int hard;
+    int multiplayer;
+} Monstercount;
+
+typedef struct {
+    int min_x;
+    int min_y;
+    int max_x;
+    int max_y;
+    int lines[NUM_LINE_CLASSES];
+    int things[NUM_THING_CLASSES];
+    Monstercount monsters[MAX_MONSTER_TYPES];
+    int num_monster_types;
+} Mapstats;
+
+unsigned int stats_needs(void) {
+    return NEED(LUMP_THINGS) | NEED(LUMP_LINEDEFS) | NEED(LUMP_VERTEXES);
+}
+
+static Monstercount* monster_count(Mapstats* stats, int16_t type) {
+    for (int i=0; i<stats->num_monster_types; ++i) {
+        if (stats->monsters[i].type == type) return &stats->monsters[i];
+    }
+    if (stats->num_monster_types == MAX_MONSTER_TYPES) return NULL;
+    Monstercount* m = &stats->monsters[stats->num_monster_types++];
+    memset(m, 0, sizeof(Monstercount));
+    m->type = type;
+    return m;
+}
+
+static void compute_stats(Wadinfo* wadinfo, Mapstats* stats) {
+    memset(stats, 0, sizeof(Mapstats));
+    if (wadinfo->num_vertexes > 0) {
+        stats->min_x = stats->max_x = wadinfo->vertexes[0].x;
+        stats->min_y = stats->max_y = wadinfo->vertexes[0].y;
+        generate_minmax(&stats->max_x, &stats->min_x, &stats->max_y, &stats->min_y, wadinfo->vertexes, wadinfo->num_vertexes);
+    }
+    for (long int i=0; i<wadinfo->num_linedefs; ++i) {
+        stats->lines[wadinfo->line_classes[i]]++;
+    }
+    for (long int i=0; i<wadinfo->num_things; ++i) {
+        Thingclass class = wadinfo->thing_classes[i];
+        stats->things[class]++;
+        if (class != THING_MONSTER) continue;
+        Thing* t = &wadinfo->things[i];
+        Monstercount* m = monster_count(stats, t->type);
+        if (m == NULL) continue;
+        m->total++;
+        if (t->flags & THING_EASY)        m->easy++;
+        if (t->flags & THING_MEDIUM)      m->medium++;
+        if (t->flags & THING_HARD)        m->hard++;
+        if (t->flags & THING_MULTIPLAYER) m->multiplayer++;
+    }
+}
+
+static void output_map_stats(Wadinfo* wadinfo, Mapstats* stats, FILE* output) {
+    fprintf(output, "{\"name\":");
+    print_json_string(output, wadinfo->mapname, 8);
+    fprintf(output, ",\"vertexes\":%ld,\"linedefs\":%ld,\"things\":%ld", wadinfo->num_vertexes, wadinfo->num_linedefs, wadinfo->num_things);
+    fprintf(output, ",\"bounds\":{\"min_x\":%d,\"min_y\":%d,\"max_x\":%d,\"max_y\":%d}", stats->min_x, stats->min_y, stats->max_x, stats->max_y);
+    fprintf(output, ",\"doors\":%d", stats->lines[LINE_DOOR] + stats->lines[LINE_BLUE_DOOR] + stats->lines[LINE_YELLOW_DOOR] + stats->lines[LINE_RED_DOOR]);
+    fprintf(output, ",\"exits\":%d,\"teleporters\":%d", stats->lines[LINE_EXIT], stats->lines[LINE_TELEPORT]);
+    fprintf(output, ",\"weapons\":%d", stats->things[THING_WEAPON]);
+    fprintf(output, ",\"keys\":{\"blue\":%d,\"red\":%d,\"yellow\":%d}", stats->things[THING_BLUE_KEY], stats->things[THING_RED_KEY], stats->things[THING_YELLOW_KEY]);
+    fprintf(output, ",\"monsters\":[");
+    for (int i=0; i<stats->num_monster_types; ++i) {
+        Monstercount* m = &stats->monsters[i];
+        fprintf(output, "%s{\"type\":%d,\"total\":%d,\"easy\":%d,\"medium\":%d,\"hard\":%d,\"multiplayer\":%d}", i ? "," : "", m->type, m->total, m->easy, m->medium, m->hard, m->multiplayer);
+    }
+    fprintf(output, "],\"line_classes\":{");
+    for (int i=0; i<NUM_LINE_CLASSES; ++i) {
+        fprintf(output, "%s\"%s\":%d", i ? "," : "", linestyles[i].name, stats->lines[i]);
+    }
+    fprintf(output, "},\"thing_classes\":{");
+    for (int i=0; i<NUM_THING_CLASSES; ++i) {
+        fprintf(output, "%s\"%s\":%d", i ? "," : "", thingstyles[i].name, stats->things[i]);
+    }
+    fprintf(output, "}}");
+}
+
+// loads, aggregates and writes the map wadinfo->mapname
+static bool wad_map_stats(Wadinfo* wadinfo, FILE* output, int* num_maps) {
+    if (!find_map(wadinfo)) {
+        fprintf(stderr, "%s not found in %s!\n", wadinfo->mapname, wadinfo->filename);
+        return false;
+    }
+    if (!load_lumps(wadinfo, stats_needs())) {
+        free_lumps(wadinfo);
+        return false;
+    }
+    if (!classify_map(wadinfo)) {
+        free_lumps(wadinfo);
+        return false;
+    }
+    Mapstats stats;
+    compute_stats(wadinfo, &stats);
+    if ((*num_maps)++) fprintf(output, ",");
+    output_map_stats(wadinfo, &stats, output);
+    free_lumps(wadinfo);
+    return true;
+}
+
+// writes one JSON object for the WAD, with the map wadinfo->mapname or
+// (if mapname is empty or *) every map in it
+bool output_wad_stats(Wadinfo* wadinfo, FILE* output) {
+    if (!read_directory(wadinfo)) return false;
+
+    fprintf(output, "{\"file\":");
+    print_json_string(output, wadinfo->filename, strlen(wadinfo->filename));
+    fprintf(output, ",\"type\":\"%s\",\"maps\":[", wadinfo->wad_ident);
+    bool ok = true;
+    int num_maps = 0;
+    if (wadinfo->mapname != NULL && wadinfo->mapname[0] != '\0' && strcmp(wadinfo->mapname, "*") != 0) {
+        ok = wad_map_stats(wadinfo, output, &num_maps);
+    }
+    else {
+        char name[9] = { 0 };
+        for (int i=0; i<wadinfo->header.num_lumps; ++i) {
+            if (!is_map_name(wadinfo->directory[i].name)) continue;
+            strncpy(name, wadinfo->directory[i].name, 8);
+            wadinfo->mapname = name;
+            // a broken map doesn't stop the others:
+            if (!wad_map_stats(wadinfo, output, &num_maps)) ok = false;
+        }
+        wadinfo->mapname = "";
+    }
+    fprintf(output, "]}\n");
+    return ok;
+}